@@ -0,0 +1,111 @@
+#include <thread>
+#include <iostream>
+#include <vector>
+#include <coroutine>
+
+#include "AsyncReadWriteMutex.h"
+
+// Demo
+// Coroutine that starts at once and destroys itself at the end
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+AsyncReadWriteMutex Arwmx;
+std::vector<int> Vec;
+std::atomic<int> FinishedTasks(0);
+
+Task ReadingTask()
+{
+    for (int i = 0; i < 100; ++i)
+    {
+        co_await Arwmx.AsyncReadLock();
+        int summ = 0;
+        for (const auto& it : Vec)
+            summ += it;
+        Arwmx.ReadUnlock();
+    }
+
+    ++FinishedTasks;
+}
+
+// Task in the chain of coroutines waiting for the same lock
+Task ChainTask(AsyncReadWriteMutex& rwmx, int& counter)
+{
+    co_await rwmx.AsyncWriteLock();
+    ++counter;
+    rwmx.WriteUnlock();
+}
+
+Task WritingTask()
+{
+    for (int i = 0; i < 100; ++i)
+    {
+        co_await Arwmx.AsyncWriteLock();
+        Vec.emplace_back(i);
+        Arwmx.WriteUnlock();
+    }
+
+    ++FinishedTasks;
+}
+
+int main()
+{
+    // 2 threads run 40 tasks
+    std::thread th1([]()
+        {
+            for (int i = 0; i < 10; ++i)
+            {
+                ReadingTask();
+                WritingTask();
+            }
+        });
+
+    std::thread th2([]()
+        {
+            for (int i = 0; i < 10; ++i)
+            {
+                ReadingTask();
+                WritingTask();
+            }
+        });
+
+    th1.join();
+    th2.join();
+
+    // Suspended tasks are resumed by the unlocks of other tasks, so all tasks are finished here
+    std::cout << "Finished tasks: " << FinishedTasks << " Vector size: " << Vec.size() << std::endl;
+
+    // Each coroutine of the chain gives the lock to the next one. They are resumed one after another, not inside each other
+    AsyncReadWriteMutex chainRwmx;
+    int chainCounter = 0;
+    chainRwmx.TryWriteLock();
+    for (int i = 0; i < 100000; ++i)
+        ChainTask(chainRwmx, chainCounter);
+    chainRwmx.WriteUnlock();
+    std::cout << "Chain tasks: " << chainCounter << std::endl;
+
+    // Executor puts the coroutines to the queue of the main thread instead of resuming them inside the unlock
+    std::vector<std::coroutine_handle<>> readyTasks;
+    AsyncReadWriteMutex executorRwmx([&readyTasks](std::coroutine_handle<> handle) { readyTasks.push_back(handle); });
+    int executorCounter = 0;
+    executorRwmx.TryWriteLock();
+    for (int i = 0; i < 10; ++i)
+        ChainTask(executorRwmx, executorCounter);
+    executorRwmx.WriteUnlock();
+    while (!readyTasks.empty())
+    {
+        std::coroutine_handle<> handle = readyTasks.back();
+        readyTasks.pop_back();
+        handle.resume();
+    }
+    std::cout << "Executor tasks: " << executorCounter << std::endl;
+}
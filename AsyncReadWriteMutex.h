@@ -0,0 +1,344 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <utility>
+
+#include "LockCommon.h"
+
+/**
+    \brief A read write lock for coroutines
+
+    Instead of blocking the thread, the lock suspends the coroutine with co_await AsyncReadLock() or co_await AsyncWriteLock().
+    Suspended coroutines are stored in the intrusive list inside their awaiters, so waiting does not allocate.
+    The unlock hands the lock over to the first waiting coroutines and resumes them after the internal state is unlocked.
+    By default they are resumed on the unlocking thread. If a resumed coroutine unlocks again, the coroutines it hands the lock to are queued
+    and resumed by the outermost unlock one after another, so a long chain of handoffs does not grow the stack.
+    Give an executor to the constructor to resume the coroutines somewhere else, for example on a thread pool, instead of the unlocking thread.
+    Waiters are served in the order of arrival: a writer gets the lock alone, and readers that come one after another get the lock together.
+    New readers do not overtake waiting writers. The internal state is protected by a short spin lock, so no thread is ever parked.
+*/
+class AsyncReadWriteMutex
+{
+public:
+    /// \brief Awaiter for the lock. It is returned by AsyncReadLock and AsyncWriteLock and must be awaited at once
+    class Awaiter
+    {
+    private:
+        friend class AsyncReadWriteMutex;
+
+        AsyncReadWriteMutex& Rwmx;
+        bool IsWrite;
+        Awaiter* Next = nullptr;
+        std::coroutine_handle<> Handle;
+
+    public:
+        Awaiter(AsyncReadWriteMutex& rwmx, bool isWrite) : Rwmx(rwmx), IsWrite(isWrite) {}
+
+        bool await_ready()
+        {
+            return IsWrite ? Rwmx.TryWriteLock() : Rwmx.TryReadLock();
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            Handle = handle;
+
+            Rwmx.LockState();
+
+            // Lock could be freed after await_ready
+            if (Rwmx.TryAcquire(IsWrite))
+            {
+                Rwmx.UnlockState();
+                return false;
+            }
+
+            if (Rwmx.Tail != nullptr)
+                Rwmx.Tail->Next = this;
+            else
+                Rwmx.Head = this;
+            Rwmx.Tail = this;
+
+            Rwmx.UnlockState();
+            return true;
+        }
+
+        void await_resume() {}
+    };
+
+private:
+    // Flag to protect the state. It is held only for a few instructions
+    std::atomic_flag StateFlag = ATOMIC_FLAG_INIT;
+
+    // Amount of readers inside the lock
+    std::size_t Readers = 0;
+
+    // True if a writer is inside the lock
+    bool IsWriter = false;
+
+    // Intrusive queue of the suspended coroutines
+    Awaiter* Head = nullptr;
+    Awaiter* Tail = nullptr;
+
+    // Function that resumes the coroutine handle. Empty means to resume on the unlocking thread
+    std::function<void(std::coroutine_handle<>)> Executor;
+
+    // Coroutines that were given the lock on this thread and wait for the outermost Resume
+    struct ResumeQueue
+    {
+        Awaiter* Head = nullptr;
+        Awaiter* Tail = nullptr;
+        bool IsResuming = false;
+    };
+
+    static ResumeQueue& GetLocalThreadResumeQueue()
+    {
+        thread_local ResumeQueue resumeQueue;
+        return resumeQueue;
+    }
+
+    void LockState()
+    {
+        while (StateFlag.test_and_set(std::memory_order_acquire))
+            while (StateFlag.test(std::memory_order_relaxed))
+                CpuRelax();
+    }
+
+    void UnlockState()
+    {
+        StateFlag.clear(std::memory_order_release);
+    }
+
+    // Tries to take the lock. Called only when the state is locked
+    bool TryAcquire(bool isWrite)
+    {
+        if (IsWriter || Head != nullptr)
+            return false;
+
+        if (isWrite)
+        {
+            if (Readers != 0)
+                return false;
+            IsWriter = true;
+        }
+        else
+            ++Readers;
+
+        return true;
+    }
+
+    // Gives the lock to the first waiters and returns the list of them. Called only when the state is locked and the lock is free
+    Awaiter* HandOff()
+    {
+        Awaiter* awaiters = Head;
+        if (awaiters == nullptr)
+            return nullptr;
+
+        Awaiter* last = awaiters;
+        if (last->IsWrite)
+            IsWriter = true;
+        else
+        {
+            ++Readers;
+            while (last->Next != nullptr && !last->Next->IsWrite)
+            {
+                last = last->Next;
+                ++Readers;
+            }
+        }
+
+        Head = last->Next;
+        if (Head == nullptr)
+            Tail = nullptr;
+        last->Next = nullptr;
+
+        return awaiters;
+    }
+
+    // Resumes the coroutines from HandOff. Called only when the state is unlocked
+    void Resume(Awaiter* awaiters)
+    {
+        if (awaiters == nullptr)
+            return;
+
+        if (Executor)
+        {
+            while (awaiters != nullptr)
+            {
+                // Awaiter is destroyed by the resumed coroutine, so the next one is taken before the resume
+                Awaiter* next = awaiters->Next;
+                Executor(awaiters->Handle);
+                awaiters = next;
+            }
+            return;
+        }
+
+        ResumeQueue& resumeQueue = GetLocalThreadResumeQueue();
+
+        Awaiter* last = awaiters;
+        while (last->Next != nullptr)
+            last = last->Next;
+
+        if (resumeQueue.Tail != nullptr)
+            resumeQueue.Tail->Next = awaiters;
+        else
+            resumeQueue.Head = awaiters;
+        resumeQueue.Tail = last;
+
+        // Unlock inside the resumed coroutine only queues the coroutines, and this loop resumes them
+        if (resumeQueue.IsResuming)
+            return;
+
+        // Queued coroutines already own the lock, so if one of them throws, the others are still resumed and the first exception is rethrown after them
+        std::exception_ptr exception;
+
+        resumeQueue.IsResuming = true;
+        while (resumeQueue.Head != nullptr)
+        {
+            // Awaiter is destroyed by the resumed coroutine, so it is removed from the queue before the resume
+            Awaiter* awaiter = resumeQueue.Head;
+            resumeQueue.Head = awaiter->Next;
+            if (resumeQueue.Head == nullptr)
+                resumeQueue.Tail = nullptr;
+
+            try
+            {
+                awaiter->Handle.resume();
+            }
+            catch (...)
+            {
+                if (!exception)
+                    exception = std::current_exception();
+            }
+        }
+        resumeQueue.IsResuming = false;
+
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+
+public:
+    AsyncReadWriteMutex() {}
+
+    /// \brief Constructor with the executor
+    /// \param [in] executor function that resumes the coroutine handle given to it, for example by posting it to a thread pool.
+    /// It is called after the internal state is unlocked, and must not resume the handle inside the call if it can be called from a coroutine
+    explicit AsyncReadWriteMutex(std::function<void(std::coroutine_handle<>)> executor) : Executor(std::move(executor)) {}
+
+    AsyncReadWriteMutex(const AsyncReadWriteMutex&) = delete;
+    AsyncReadWriteMutex& operator=(const AsyncReadWriteMutex&) = delete;
+
+    /// \brief A method for locking for reading. Use it as co_await AsyncReadLock()
+    /// \return awaiter that resumes the coroutine when the read lock is taken
+    Awaiter AsyncReadLock()
+    {
+        return Awaiter(*this, false);
+    }
+
+    /// \brief A method for locking for writing. Use it as co_await AsyncWriteLock()
+    /// \return awaiter that resumes the coroutine when the write lock is taken
+    Awaiter AsyncWriteLock()
+    {
+        return Awaiter(*this, true);
+    }
+
+    /// \brief A method for trying to lock for reading without waiting
+    /// \return true if locked, false otherwise
+    bool TryReadLock()
+    {
+        LockState();
+        bool isLocked = TryAcquire(false);
+        UnlockState();
+        return isLocked;
+    }
+
+    /// \brief A method for trying to lock for writing without waiting
+    /// \return true if locked, false otherwise
+    bool TryWriteLock()
+    {
+        LockState();
+        bool isLocked = TryAcquire(true);
+        UnlockState();
+        return isLocked;
+    }
+
+    /// \brief A method for unlocking for reading. The last reader resumes the waiting writer on the current thread or with the executor
+    void ReadUnlock()
+    {
+        Awaiter* awaiters = nullptr;
+
+        LockState();
+        if (--Readers == 0)
+            awaiters = HandOff();
+        UnlockState();
+
+        Resume(awaiters);
+    }
+
+    /// \brief A method for unlocking for writing. Resumes the next waiters on the current thread or with the executor
+    void WriteUnlock()
+    {
+        LockState();
+        IsWriter = false;
+        Awaiter* awaiters = HandOff();
+        UnlockState();
+
+        Resume(awaiters);
+    }
+};
+
+/**
+    \brief A crosswalk for coroutines
+
+    The same crosswalk as ThreadCrossWalk from CrossWalk.h, but cars and pedestrians are coroutines that wait with co_await
+    instead of blocking the thread. Cars are readers and pedestrians are writers of AsyncReadWriteMutex,
+    so the pedestrian stops the new cars and crosses the road when the cars that were on the road leave it.
+*/
+class AsyncThreadCrossWalk
+{
+private:
+    AsyncReadWriteMutex Rwmx;
+
+public:
+    AsyncThreadCrossWalk() {}
+
+    /// Cars and pedestrians that waited are resumed with the executor. See AsyncReadWriteMutex
+    explicit AsyncThreadCrossWalk(std::function<void(std::coroutine_handle<>)> executor) : Rwmx(std::move(executor)) {}
+
+    /// Use it as co_await AsyncCarStartCrossRoad()
+    AsyncReadWriteMutex::Awaiter AsyncCarStartCrossRoad()
+    {
+        return Rwmx.AsyncReadLock();
+    }
+
+    /// Same as AsyncCarStartCrossRoad, but returns false instead of waiting for the pedestrian
+    bool TryCarStartCrossRoad()
+    {
+        return Rwmx.TryReadLock();
+    }
+
+    void CarStopCrossRoad()
+    {
+        Rwmx.ReadUnlock();
+    }
+
+    /// Use it as co_await AsyncPedestrianStartCrossRoad()
+    AsyncReadWriteMutex::Awaiter AsyncPedestrianStartCrossRoad()
+    {
+        return Rwmx.AsyncWriteLock();
+    }
+
+    /// Same as AsyncPedestrianStartCrossRoad, but returns false instead of waiting for the cars or another pedestrian
+    bool TryPedestrianStartCrossRoad()
+    {
+        return Rwmx.TryWriteLock();
+    }
+
+    void PedestrianStopCrossRoad()
+    {
+        Rwmx.WriteUnlock();
+    }
+};
@@ -0,0 +1,1000 @@
+// Benchmark of all lock classes against std::shared_mutex and pthread_rwlock_t.
+// Build: g++ -std=c++20 -O2 -pthread Benchmark.cpp -lbenchmark -o Benchmark
+//
+// Each benchmark is swept over:
+//   - threads from 1 to the amount of cores,
+//   - percent of read operations from 100 to 50,
+//   - critical section length in CpuRelax calls,
+//   - amount of lock objects the threads spread over: 1 is the highest contention.
+// Reported counters: items_per_second is the throughput of all threads,
+// p50_ns, p99_ns and p999_ns are acquire latency percentiles over the merged samples of all threads.
+//
+// BM_NeighbouringLocks measures false sharing: each thread locks only its own lock,
+// and the locks are packed in a usual array or padded with CacheAlignedArray.
+//
+// BM_ReadBatch compares the read lock for every item of a batch with one ReadSession for the whole batch,
+// while the first thread writes. writer_ns is the average write lock latency.
+//
+// Besides the benchmarks the program has its own modes:
+//   --stress                     runs random schedules of all lock methods on every lock class and the lock guards and checks
+//                                the mutual exclusion, build with -fsanitize=thread to check the data races too,
+//   --stress_ms=<milliseconds>   time of the stress run for one lock class, 1000 by default,
+//   --stress_no_timed            excludes the timed locks from the stress run. The thread sanitizer does not see
+//                                the locks of std::timed_mutex::try_lock_until, so its reports after the timed locks are false,
+//   --baseline_save=<file>       saves items_per_second of every benchmark to the file,
+//   --baseline_check=<file>      compares items_per_second with the saved ones and fails if any benchmark is slower,
+//                                if a benchmark of the baseline was not run or if the baseline is broken,
+//   --baseline_tolerance=<ratio> allowed slowdown for --baseline_check, 0.1 by default.
+// Baselines depend on the machine, so save them on the machine that checks them, with the same filter, for example:
+//   ./Benchmark --benchmark_filter=BM_Lock --baseline_save=baseline.txt
+//   ./Benchmark --benchmark_filter=BM_Lock --baseline_check=baseline.txt
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <coroutine>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+#include <benchmark/benchmark.h>
+
+#include "ReadWriteMutex.h"
+#include "CrossWalk.h"
+#include "CrossWalkLockFree.h"
+#include "CrossWalkRcu.h"
+#include "AsyncReadWriteMutex.h"
+
+/// \brief Wrapper to use pthread_rwlock_t through the std::shared_mutex names
+class PthreadReadWriteLock
+{
+private:
+    pthread_rwlock_t Lock;
+
+public:
+    PthreadReadWriteLock() { pthread_rwlock_init(&Lock, nullptr); }
+    ~PthreadReadWriteLock() { pthread_rwlock_destroy(&Lock); }
+
+    void lock() { pthread_rwlock_wrlock(&Lock); }
+    void unlock() { pthread_rwlock_unlock(&Lock); }
+    void lock_shared() { pthread_rwlock_rdlock(&Lock); }
+    void unlock_shared() { pthread_rwlock_unlock(&Lock); }
+};
+
+// Maximum amount of lock objects in one benchmark
+constexpr int MaxLocksAmount = 8;
+
+// Returns the latency percentile from the sorted samples
+static double GetPercentile(const std::vector<std::uint32_t>& sortedSamples, double percentile)
+{
+    if (sortedSamples.empty())
+        return 0;
+
+    std::size_t index = static_cast<std::size_t>(percentile * static_cast<double>(sortedSamples.size() - 1));
+    return sortedSamples[index];
+}
+
+/**
+    \brief Benchmark of one lock class
+
+    Every iteration takes a random lock object, locks it for reading or writing, spins in the critical section and unlocks it.
+    Acquire latency is measured for every iteration. Samples of all threads are merged after the run,
+    so the percentiles show the tail of the whole run and not an average of the per-thread tails.
+
+    \tparam Lock lock class with std::shared_mutex compatible names
+*/
+template <class Lock>
+static void BM_Lock(benchmark::State& state)
+{
+    static Lock locks[MaxLocksAmount];
+
+    // Merged samples of all threads of the run and the amount of threads that added their samples
+    static std::mutex samplesMutex;
+    static std::vector<std::uint32_t> allLatencies;
+    static std::atomic<int> finishedThreads{0};
+
+    const int readPercent = static_cast<int>(state.range(0));
+    const int criticalSectionLength = static_cast<int>(state.range(1));
+    const int locksAmount = static_cast<int>(state.range(2));
+
+    std::minstd_rand random(static_cast<unsigned>(state.thread_index() + 1));
+    std::vector<std::uint32_t> latencies;
+    latencies.reserve(1 << 20);
+
+    for (auto _ : state)
+    {
+        Lock& lock = locks[random() % locksAmount];
+        bool isRead = static_cast<int>(random() % 100) < readPercent;
+
+        auto start = std::chrono::steady_clock::now();
+        if (isRead)
+            lock.lock_shared();
+        else
+            lock.lock();
+        auto acquired = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < criticalSectionLength; ++i)
+            CpuRelax();
+
+        if (isRead)
+            lock.unlock_shared();
+        else
+            lock.unlock();
+
+        latencies.push_back(static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(acquired - start).count()));
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(samplesMutex);
+        allLatencies.insert(allLatencies.end(), latencies.begin(), latencies.end());
+    }
+    finishedThreads.fetch_add(1, std::memory_order_release);
+
+    state.SetItemsProcessed(state.iterations());
+
+    // Counters of the threads are summed, so only the first thread reports the percentiles after all threads added their samples
+    if (state.thread_index() != 0)
+        return;
+
+    while (finishedThreads.load(std::memory_order_acquire) != state.threads())
+        std::this_thread::yield();
+
+    std::lock_guard<std::mutex> lk(samplesMutex);
+    std::sort(allLatencies.begin(), allLatencies.end());
+
+    state.counters["p50_ns"] = benchmark::Counter(GetPercentile(allLatencies, 0.5));
+    state.counters["p99_ns"] = benchmark::Counter(GetPercentile(allLatencies, 0.99));
+    state.counters["p999_ns"] = benchmark::Counter(GetPercentile(allLatencies, 0.999));
+
+    // Next run of this benchmark starts after all threads of this run ended
+    allLatencies.clear();
+    finishedThreads.store(0, std::memory_order_relaxed);
+}
+
+// Sets the sweep of read percent, critical section length and amount of lock objects
+static void SetSweep(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->ArgNames({ "read%", "cs", "locks" });
+    benchmark->ArgsProduct({ { 100, 95, 80, 50 }, { 0, 64, 1024 }, { 1, MaxLocksAmount } });
+    benchmark->ThreadRange(1, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+    benchmark->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_Lock, ReadWriteMutex<WriterPreferringPolicy>)->Apply(SetSweep);
+BENCHMARK_TEMPLATE(BM_Lock, ReadWriteMutex<ReaderPreferringPolicy>)->Apply(SetSweep);
+BENCHMARK_TEMPLATE(BM_Lock, ReadWriteMutex<PhaseFairPolicy>)->Apply(SetSweep);
+BENCHMARK_TEMPLATE(BM_Lock, RecursiveReadWriteMutex<>)->Apply(SetSweep);
+BENCHMARK_TEMPLATE(BM_Lock, ShardedReadWriteMutex)->Apply(SetSweep);
+BENCHMARK_TEMPLATE(BM_Lock, CompactReadWriteMutex)->Apply(SetSweep);
+BENCHMARK_TEMPLATE(BM_Lock, NumaReadWriteMutex<>)->Apply(SetSweep);
+BENCHMARK_TEMPLATE(BM_Lock, PriorityReadWriteMutex)->Apply(SetSweep);
+BENCHMARK_TEMPLATE(BM_Lock, ThreadCrossWalk<>)->Apply(SetSweep);
+BENCHMARK_TEMPLATE(BM_Lock, ThreadCrossWalk<BatchedWriterPolicy<8>>)->Apply(SetSweep);
+BENCHMARK_TEMPLATE(BM_Lock, LockFreeThreadCrossWalk)->Apply(SetSweep);
+BENCHMARK_TEMPLATE(BM_Lock, std::shared_mutex)->Apply(SetSweep);
+BENCHMARK_TEMPLATE(BM_Lock, PthreadReadWriteLock)->Apply(SetSweep);
+
+// Maximum amount of threads in the benchmark of the neighbouring locks
+constexpr std::size_t MaxNeighbouringLocksAmount = 64;
+
+/// \brief Usual array of locks without padding, so neighbouring locks can share a cache line
+template <class Lock, std::size_t N>
+class PackedArray
+{
+private:
+    Lock Locks[N];
+
+public:
+    Lock& operator[](std::size_t index) { return Locks[index]; }
+};
+
+/**
+    \brief Benchmark of the neighbouring locks
+
+    Every thread locks only its own lock, so the locks are not contended, and the difference between the packed and the padded arrays is the cost of false sharing.
+    Every eighth lock is the write lock.
+
+    \tparam Locks array of locks with std::shared_mutex compatible names
+*/
+template <class Locks>
+static void BM_NeighbouringLocks(benchmark::State& state)
+{
+    static Locks locks;
+    auto& lock = locks[static_cast<std::size_t>(state.thread_index()) % MaxNeighbouringLocksAmount];
+
+    std::size_t i = 0;
+    for (auto _ : state)
+    {
+        if (++i % 8 == 0)
+        {
+            lock.lock();
+            lock.unlock();
+        }
+        else
+        {
+            lock.lock_shared();
+            lock.unlock_shared();
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Sets the sweep of threads for the benchmark of the neighbouring locks
+static void SetNeighbouringSweep(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->ThreadRange(1, static_cast<int>(std::min<std::size_t>(MaxNeighbouringLocksAmount, std::max(1u, std::thread::hardware_concurrency()))));
+    benchmark->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_NeighbouringLocks, PackedArray<CompactReadWriteMutex, MaxNeighbouringLocksAmount>)->Apply(SetNeighbouringSweep);
+BENCHMARK_TEMPLATE(BM_NeighbouringLocks, CacheAlignedArray<CompactReadWriteMutex, MaxNeighbouringLocksAmount>)->Apply(SetNeighbouringSweep);
+BENCHMARK_TEMPLATE(BM_NeighbouringLocks, PackedArray<std::shared_mutex, MaxNeighbouringLocksAmount>)->Apply(SetNeighbouringSweep);
+BENCHMARK_TEMPLATE(BM_NeighbouringLocks, CacheAlignedArray<std::shared_mutex, MaxNeighbouringLocksAmount>)->Apply(SetNeighbouringSweep);
+BENCHMARK_TEMPLATE(BM_NeighbouringLocks, PackedArray<ReadWriteMutex<>, MaxNeighbouringLocksAmount>)->Apply(SetNeighbouringSweep);
+
+// Amount of items in one read batch
+constexpr std::size_t ReadBatchSize = 64;
+
+/**
+    \brief Benchmark of the batch of short read sections
+
+    The first thread is the writer, and the other threads read batches of items.
+    If IsSession is false, every item is read under its own read lock, otherwise the whole batch is read in one ReadSession with Checkpoint after each item.
+
+    \tparam Lock lock class with std::shared_mutex compatible names and the IsWriterWaiting or the IsPedestrianWaiting method
+    \tparam IsSession true to read the batch in one ReadSession
+*/
+template <class Lock, bool IsSession>
+static void BM_ReadBatch(benchmark::State& state)
+{
+    static Lock lock;
+    static int items[ReadBatchSize];
+
+    if (state.thread_index() == 0)
+    {
+        std::uint64_t writeNanoseconds = 0;
+        for (auto _ : state)
+        {
+            auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            writeNanoseconds += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            for (int& item : items)
+                ++item;
+            lock.unlock();
+        }
+
+        state.counters["writer_ns"] = benchmark::Counter(static_cast<double>(writeNanoseconds) / static_cast<double>(std::max<benchmark::IterationCount>(1, state.iterations())));
+        return;
+    }
+
+    int sum = 0;
+    for (auto _ : state)
+    {
+        if constexpr (IsSession)
+        {
+            ReadSession<Lock> session(lock);
+            for (std::size_t i = 0; i < ReadBatchSize; ++i)
+            {
+                sum += items[i];
+                session.Checkpoint();
+            }
+        }
+        else
+        {
+            for (std::size_t i = 0; i < ReadBatchSize; ++i)
+            {
+                lock.lock_shared();
+                sum += items[i];
+                lock.unlock_shared();
+            }
+        }
+    }
+
+    benchmark::DoNotOptimize(sum);
+    state.SetItemsProcessed(state.iterations() * static_cast<benchmark::IterationCount>(ReadBatchSize));
+}
+
+// Sets the sweep of threads for the benchmark of the read batches. There is at least one reader besides the writer
+static void SetReadBatchSweep(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->ThreadRange(2, static_cast<int>(std::max(2u, std::thread::hardware_concurrency())));
+    benchmark->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_ReadBatch, ReadWriteMutex<>, false)->Apply(SetReadBatchSweep);
+BENCHMARK_TEMPLATE(BM_ReadBatch, ReadWriteMutex<>, true)->Apply(SetReadBatchSweep);
+BENCHMARK_TEMPLATE(BM_ReadBatch, CompactReadWriteMutex, false)->Apply(SetReadBatchSweep);
+BENCHMARK_TEMPLATE(BM_ReadBatch, CompactReadWriteMutex, true)->Apply(SetReadBatchSweep);
+BENCHMARK_TEMPLATE(BM_ReadBatch, ThreadCrossWalk<>, false)->Apply(SetReadBatchSweep);
+BENCHMARK_TEMPLATE(BM_ReadBatch, ThreadCrossWalk<>, true)->Apply(SetReadBatchSweep);
+BENCHMARK_TEMPLATE(BM_ReadBatch, LockFreeThreadCrossWalk, false)->Apply(SetReadBatchSweep);
+BENCHMARK_TEMPLATE(BM_ReadBatch, LockFreeThreadCrossWalk, true)->Apply(SetReadBatchSweep);
+
+/**
+    \brief Shadow state of the data protected by one lock in the stress runs
+
+    Read and Write are called inside the read and write sections. The shadow counters of readers and writers check the mutual exclusion,
+    and writers change two plain variables that readers compare, so broken exclusion is also seen by the thread sanitizer.
+    At the end the amount of write sections must be equal to the changes of the variables.
+*/
+class StressShadow
+{
+private:
+    std::atomic<int> Readers{0};
+    std::atomic<int> Writers{0};
+    std::atomic<long long> WritesAmount{0};
+    std::atomic<long long> ErrorsAmount{0};
+
+    // Protected by the lock
+    long long First = 0;
+    long long Second = 0;
+
+public:
+    /// \brief Method to call inside the read section
+    void Read()
+    {
+        Readers.fetch_add(1);
+        if (Writers.load() != 0)
+            ErrorsAmount.fetch_add(1);
+        if (First != Second)
+            ErrorsAmount.fetch_add(1);
+        Readers.fetch_sub(1);
+    }
+
+    /// \brief Method to call inside the write section
+    void Write()
+    {
+        if (Writers.fetch_add(1) != 0 || Readers.load() != 0)
+            ErrorsAmount.fetch_add(1);
+        ++First;
+        ++Second;
+        WritesAmount.fetch_add(1);
+        Writers.fetch_sub(1);
+    }
+
+    /// \brief Method to call on the error found outside the sections
+    void AddError()
+    {
+        ErrorsAmount.fetch_add(1);
+    }
+
+    /// \brief Method to call after all threads are joined
+    /// \return amount of errors
+    long long GetErrorsAmount() const
+    {
+        return ErrorsAmount.load() + (First != WritesAmount.load() || Second != WritesAmount.load() ? 1 : 0);
+    }
+
+    /// \return amount of write sections
+    long long GetWritesAmount() const
+    {
+        return WritesAmount.load();
+    }
+};
+
+// Runs the operation on several threads until the time is over. The operation gets the random generator. Returns the amount of operations
+template <class Operation>
+static long long RunStressThreads(std::chrono::milliseconds duration, Operation operation)
+{
+    std::atomic<long long> operationsAmount(0);
+    std::atomic<bool> isStopped(false);
+
+    std::vector<std::thread> threads;
+    unsigned threadsAmount = std::max(4u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threadsAmount; ++i)
+        threads.emplace_back([&, i]()
+            {
+                std::minstd_rand random(i + 1);
+                while (!isStopped.load(std::memory_order_relaxed))
+                {
+                    operation(random);
+                    operationsAmount.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+
+    std::this_thread::sleep_for(duration);
+    isStopped.store(true);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    return operationsAmount.load();
+}
+
+// Prints the result of the stress run. Returns true if there are no errors
+static bool ReportStress(const char* name, long long operationsAmount, long long writesAmount, long long errorsAmount)
+{
+    std::cout << (errorsAmount == 0 ? "OK   " : "FAIL ") << name << ": " << operationsAmount << " operations, " <<
+        writesAmount << " writes, " << errorsAmount << " errors" << std::endl;
+    return errorsAmount == 0;
+}
+
+/**
+    \brief Stress run of one lock class
+
+    Threads take the lock with random methods: blocking, try and timed locks for reading and writing, and ReadSession if the lock supports it.
+
+    \tparam Lock lock class with std::shared_mutex compatible names
+    \param [in] name lock class name for the report
+    \param [in] duration time of the run
+    \param [in] isTimed true to use the timed locks
+    \return true if no check failed
+*/
+template <class Lock>
+static bool StressLock(const char* name, std::chrono::milliseconds duration, bool isTimed)
+{
+    Lock lock;
+    StressShadow shadow;
+    const auto timeout = std::chrono::microseconds(50);
+
+    long long operationsAmount = RunStressThreads(duration, [&](std::minstd_rand& random)
+        {
+            switch (random() % 8)
+            {
+            case 0:
+            case 1:
+                lock.lock_shared();
+                shadow.Read();
+                lock.unlock_shared();
+                break;
+            case 2:
+                lock.lock();
+                shadow.Write();
+                lock.unlock();
+                break;
+            case 3:
+                if constexpr (requires { lock.try_lock_shared(); })
+                    if (lock.try_lock_shared())
+                    {
+                        shadow.Read();
+                        lock.unlock_shared();
+                    }
+                break;
+            case 4:
+                if constexpr (requires { lock.try_lock(); })
+                    if (lock.try_lock())
+                    {
+                        shadow.Write();
+                        lock.unlock();
+                    }
+                break;
+            case 5:
+                if constexpr (requires { lock.try_lock_shared_for(timeout); })
+                    if (isTimed && lock.try_lock_shared_for(timeout))
+                    {
+                        shadow.Read();
+                        lock.unlock_shared();
+                    }
+                break;
+            case 6:
+                if constexpr (requires { lock.try_lock_for(timeout); })
+                    if (isTimed && lock.try_lock_for(timeout))
+                    {
+                        shadow.Write();
+                        lock.unlock();
+                    }
+                break;
+            case 7:
+                if constexpr (requires { lock.IsWriterWaiting(); } || requires { lock.IsPedestrianWaiting(); })
+                {
+                    ReadSession<Lock> session(lock);
+                    for (unsigned i = random() % 16; i > 0; --i)
+                    {
+                        shadow.Read();
+                        session.Checkpoint();
+                    }
+                }
+                break;
+            }
+        });
+
+    return ReportStress(name, operationsAmount, shadow.GetWritesAmount(), shadow.GetErrorsAmount());
+}
+
+/**
+    \brief Stress run of the lock guards
+
+    Threads lock two mutexes with ReadLock and WriteLock guards: blocking, deferred, try and moved guards,
+    ScopedReadLock and ScopedWriteLock of both mutexes in both orders, and std::lock of the mixed read and write guards.
+    Opposite orders deadlock if the guards of several mutexes do not avoid it.
+
+    \param [in] duration time of the run
+    \return true if no check failed
+*/
+static bool StressGuards(std::chrono::milliseconds duration)
+{
+    using Mutex = ReadWriteMutex<>;
+
+    Mutex first, second;
+    StressShadow firstShadow, secondShadow;
+
+    long long operationsAmount = RunStressThreads(duration, [&](std::minstd_rand& random)
+        {
+            switch (random() % 8)
+            {
+            case 0:
+            {
+                ReadLock<Mutex> lk(first);
+                firstShadow.Read();
+                break;
+            }
+            case 1:
+            {
+                WriteLock<Mutex> lk(second);
+                secondShadow.Write();
+                WriteLock<Mutex> movedLk(std::move(lk));
+                if (lk.OwnsLock() || !movedLk.OwnsLock())
+                    secondShadow.AddError();
+                secondShadow.Write();
+                break;
+            }
+            case 2:
+            {
+                ReadLock<Mutex> lk(second, std::try_to_lock);
+                if (lk)
+                    secondShadow.Read();
+                break;
+            }
+            case 3:
+            {
+                WriteLock<Mutex> lk(first, std::defer_lock);
+                lk.Lock();
+                firstShadow.Write();
+                lk.Unlock();
+                if (lk.OwnsLock())
+                    firstShadow.AddError();
+                break;
+            }
+            case 4:
+            {
+                ScopedReadLock<Mutex, Mutex> lk(first, second);
+                firstShadow.Read();
+                secondShadow.Read();
+                break;
+            }
+            case 5:
+            {
+                ScopedWriteLock<Mutex, Mutex> lk(first, second);
+                firstShadow.Write();
+                secondShadow.Write();
+                break;
+            }
+            case 6:
+            {
+                ScopedWriteLock<Mutex, Mutex> lk(second, first);
+                firstShadow.Write();
+                secondShadow.Write();
+                break;
+            }
+            case 7:
+            {
+                ReadLock<Mutex> readLk(second, std::defer_lock);
+                WriteLock<Mutex> writeLk(first, std::defer_lock);
+                std::lock(readLk, writeLk);
+                firstShadow.Write();
+                secondShadow.Read();
+                break;
+            }
+            }
+        });
+
+    return ReportStress("ReadLock, WriteLock, ScopedReadLock, ScopedWriteLock", operationsAmount,
+        firstShadow.GetWritesAmount() + secondShadow.GetWritesAmount(), firstShadow.GetErrorsAmount() + secondShadow.GetErrorsAmount());
+}
+
+/**
+    \brief Stress run of StripedReadWriteMutex
+
+    Threads lock random keys for reading and one or two random keys for writing, so the stripes of several keys are locked in the same order
+    and the keys hashed onto the same stripe are locked once. Each key has its own shadow state.
+
+    \param [in] duration time of the run
+    \return true if no check failed
+*/
+static bool StressStriped(std::chrono::milliseconds duration)
+{
+    constexpr int KeysAmount = 16;
+
+    StripedReadWriteMutex<4> stripes;
+    StressShadow shadows[KeysAmount];
+
+    long long operationsAmount = RunStressThreads(duration, [&](std::minstd_rand& random)
+        {
+            int key = static_cast<int>(random() % KeysAmount);
+            int otherKey = static_cast<int>(random() % KeysAmount);
+
+            switch (random() % 5)
+            {
+            case 0:
+            case 1:
+                stripes.ReadLock(key);
+                shadows[key].Read();
+                stripes.ReadUnlock(key);
+                break;
+            case 2:
+                if (stripes.TryReadLock(key))
+                {
+                    shadows[key].Read();
+                    stripes.ReadUnlock(key);
+                }
+                break;
+            case 3:
+                stripes.WriteLock(key, otherKey);
+                shadows[key].Write();
+                if (otherKey != key)
+                    shadows[otherKey].Write();
+                stripes.WriteUnlock(key, otherKey);
+                break;
+            case 4:
+                if (stripes.TryWriteLock(key))
+                {
+                    shadows[key].Write();
+                    stripes.WriteUnlock(key);
+                }
+                break;
+            }
+        });
+
+    long long writesAmount = 0;
+    long long errorsAmount = 0;
+    for (const StressShadow& shadow : shadows)
+    {
+        writesAmount += shadow.GetWritesAmount();
+        errorsAmount += shadow.GetErrorsAmount();
+    }
+
+    return ReportStress("StripedReadWriteMutex<4>", operationsAmount, writesAmount, errorsAmount);
+}
+
+// Road of the stress run of RcuThreadCrossWalk. Every version has equal fields
+struct StressRoad
+{
+    long long First = 0;
+    long long Second = 0;
+};
+
+/**
+    \brief Stress run of RcuThreadCrossWalk
+
+    Cars are not stopped by pedestrians, so instead of the mutual exclusion cars check that their version of the road is consistent
+    and alive, which the address and the thread sanitizers check too. Pedestrians change the road and sometimes wait for the grace period.
+    At the end the road must have all changes of the pedestrians.
+
+    \param [in] duration time of the run
+    \return true if no check failed
+*/
+static bool StressRcu(std::chrono::milliseconds duration)
+{
+    RcuThreadCrossWalk<StressRoad> crosswalk(new StressRoad);
+    std::atomic<long long> writesAmount(0);
+    std::atomic<long long> errorsAmount(0);
+
+    long long operationsAmount = RunStressThreads(duration, [&](std::minstd_rand& random)
+        {
+            switch (random() % 8)
+            {
+            case 0:
+                crosswalk.PedestrianCrossRoad([](StressRoad& road)
+                    {
+                        ++road.First;
+                        ++road.Second;
+                    });
+                writesAmount.fetch_add(1);
+                break;
+            case 1:
+                crosswalk.Synchronize();
+                break;
+            default:
+            {
+                unsigned epochIndex = crosswalk.CarStartCrossRoad();
+                const StressRoad* road = crosswalk.GetRoad();
+                if (road->First != road->Second)
+                    errorsAmount.fetch_add(1);
+                crosswalk.CarStopCrossRoad(epochIndex);
+                break;
+            }
+            }
+        });
+
+    const StressRoad* road = crosswalk.GetRoad();
+    if (road->First != writesAmount.load() || road->Second != writesAmount.load())
+        errorsAmount.fetch_add(1);
+
+    return ReportStress("RcuThreadCrossWalk", operationsAmount, writesAmount.load(), errorsAmount.load());
+}
+
+// Coroutine of the stress run of AsyncReadWriteMutex that starts at once and destroys itself at the end
+struct StressTask
+{
+    struct promise_type
+    {
+        StressTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// One section of the stress run of AsyncReadWriteMutex. Sets the flag at the end
+static StressTask AsyncStressSection(AsyncReadWriteMutex& rwmx, StressShadow& shadow, bool isWrite, std::atomic<bool>& isDone)
+{
+    if (isWrite)
+    {
+        co_await rwmx.AsyncWriteLock();
+        shadow.Write();
+        rwmx.WriteUnlock();
+    }
+    else
+    {
+        co_await rwmx.AsyncReadLock();
+        shadow.Read();
+        rwmx.ReadUnlock();
+    }
+
+    isDone.store(true, std::memory_order_release);
+}
+
+/**
+    \brief Stress run of AsyncReadWriteMutex
+
+    Every thread drives one coroutine at a time: it starts the coroutine and waits until it is done,
+    while the suspended coroutine is resumed by the unlock on another thread. Try locks are used without coroutines.
+
+    \param [in] duration time of the run
+    \return true if no check failed
+*/
+static bool StressAsync(std::chrono::milliseconds duration)
+{
+    AsyncReadWriteMutex rwmx;
+    StressShadow shadow;
+
+    long long operationsAmount = RunStressThreads(duration, [&](std::minstd_rand& random)
+        {
+            switch (random() % 6)
+            {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+            {
+                std::atomic<bool> isDone(false);
+                AsyncStressSection(rwmx, shadow, random() % 4 == 0, isDone);
+                while (!isDone.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+                break;
+            }
+            case 4:
+                if (rwmx.TryReadLock())
+                {
+                    shadow.Read();
+                    rwmx.ReadUnlock();
+                }
+                break;
+            case 5:
+                if (rwmx.TryWriteLock())
+                {
+                    shadow.Write();
+                    rwmx.WriteUnlock();
+                }
+                break;
+            }
+        });
+
+    return ReportStress("AsyncReadWriteMutex", operationsAmount, shadow.GetWritesAmount(), shadow.GetErrorsAmount());
+}
+
+// Stress runs of all lock classes. Returns true if all of them passed
+static bool StressAllLocks(std::chrono::milliseconds duration, bool isTimed)
+{
+    bool isPassed = true;
+    isPassed = StressLock<ReadWriteMutex<WriterPreferringPolicy>>("ReadWriteMutex<WriterPreferringPolicy>", duration, isTimed) && isPassed;
+    isPassed = StressLock<ReadWriteMutex<ReaderPreferringPolicy>>("ReadWriteMutex<ReaderPreferringPolicy>", duration, isTimed) && isPassed;
+    isPassed = StressLock<ReadWriteMutex<PhaseFairPolicy>>("ReadWriteMutex<PhaseFairPolicy>", duration, isTimed) && isPassed;
+    isPassed = StressLock<RecursiveReadWriteMutex<>>("RecursiveReadWriteMutex<>", duration, isTimed) && isPassed;
+    isPassed = StressLock<ShardedReadWriteMutex>("ShardedReadWriteMutex", duration, isTimed) && isPassed;
+    isPassed = StressLock<CompactReadWriteMutex>("CompactReadWriteMutex", duration, isTimed) && isPassed;
+    isPassed = StressLock<NumaReadWriteMutex<>>("NumaReadWriteMutex<>", duration, isTimed) && isPassed;
+    isPassed = StressLock<PriorityReadWriteMutex>("PriorityReadWriteMutex", duration, isTimed) && isPassed;
+    isPassed = StressLock<ThreadCrossWalk<>>("ThreadCrossWalk<>", duration, isTimed) && isPassed;
+    isPassed = StressLock<ThreadCrossWalk<BatchedWriterPolicy<8>>>("ThreadCrossWalk<BatchedWriterPolicy<8>>", duration, isTimed) && isPassed;
+    isPassed = StressLock<LockFreeThreadCrossWalk>("LockFreeThreadCrossWalk", duration, isTimed) && isPassed;
+    isPassed = StressLock<std::shared_mutex>("std::shared_mutex", duration, isTimed) && isPassed;
+    isPassed = StressGuards(duration) && isPassed;
+    isPassed = StressStriped(duration) && isPassed;
+    isPassed = StressRcu(duration) && isPassed;
+    isPassed = StressAsync(duration) && isPassed;
+    return isPassed;
+}
+
+/// \brief Console reporter that also collects items_per_second of every benchmark for the baseline
+class BaselineReporter : public benchmark::ConsoleReporter
+{
+private:
+    // Sum of items_per_second and amount of repetitions by benchmark name
+    std::map<std::string, std::pair<double, int>> Throughputs;
+
+public:
+    void ReportRuns(const std::vector<Run>& reports) override
+    {
+        for (const Run& run : reports)
+        {
+            if (run.run_type != Run::RT_Iteration)
+                continue;
+
+            auto counter = run.counters.find("items_per_second");
+            if (counter == run.counters.end())
+                continue;
+
+            auto& throughput = Throughputs[run.benchmark_name()];
+            throughput.first += counter->second.value;
+            ++throughput.second;
+        }
+
+        ConsoleReporter::ReportRuns(reports);
+    }
+
+    /// \return average items_per_second of every benchmark by name
+    std::map<std::string, double> GetThroughputs() const
+    {
+        std::map<std::string, double> throughputs;
+        for (const auto& [name, throughput] : Throughputs)
+            throughputs[name] = throughput.first / throughput.second;
+        return throughputs;
+    }
+};
+
+// Saves the baseline as lines with the benchmark name and items_per_second separated by tab
+static bool SaveBaseline(const std::string& fileName, const std::map<std::string, double>& throughputs)
+{
+    std::ofstream file(fileName);
+    for (const auto& [name, throughput] : throughputs)
+        file << name << '\t' << throughput << '\n';
+
+    return static_cast<bool>(file);
+}
+
+// Parses the whole string as a number. Returns false if it is not a number
+template <class Number>
+static bool ParseNumber(const std::string& text, Number& value)
+{
+    const char* end = text.data() + text.size();
+    auto [last, error] = std::from_chars(text.data(), end, value);
+    return error == std::errc() && last == end;
+}
+
+/**
+    \brief Compares the throughputs with the baseline
+
+    Every benchmark of the baseline must be in the current run, so a renamed or removed benchmark fails the check.
+    Run the check with the same filter as the baseline was saved with.
+
+    \param [in] fileName baseline file from SaveBaseline
+    \param [in] throughputs items_per_second of the current run by benchmark name
+    \param [in] tolerance allowed slowdown ratio
+    \return false if the baseline is broken, a benchmark is missing or slower than the baseline by more than the tolerance
+*/
+static bool CheckBaseline(const std::string& fileName, const std::map<std::string, double>& throughputs, double tolerance)
+{
+    std::ifstream file(fileName);
+    if (!file)
+    {
+        std::cerr << "Can not open the baseline " << fileName << std::endl;
+        return false;
+    }
+
+    bool isPassed = true;
+    std::size_t entriesAmount = 0;
+    std::string line;
+    for (std::size_t lineNumber = 1; std::getline(file, line); ++lineNumber)
+    {
+        if (line.empty())
+            continue;
+
+        std::size_t separator = line.rfind('\t');
+        double baseline = 0;
+        if (separator == std::string::npos || separator == 0 || !ParseNumber(line.substr(separator + 1), baseline))
+        {
+            std::cerr << "Broken baseline line " << fileName << ":" << lineNumber << ": " << line << std::endl;
+            isPassed = false;
+            continue;
+        }
+
+        ++entriesAmount;
+        std::string name = line.substr(0, separator);
+        auto current = throughputs.find(name);
+        if (current == throughputs.end())
+        {
+            std::cerr << "Missing: " << name << " is in the baseline, but it was not run" << std::endl;
+            isPassed = false;
+            continue;
+        }
+
+        if (current->second < baseline * (1 - tolerance))
+        {
+            std::cerr << "Regression: " << current->first << " " << current->second << " items_per_second, baseline " << baseline << std::endl;
+            isPassed = false;
+        }
+    }
+
+    if (entriesAmount == 0)
+    {
+        std::cerr << "Empty baseline " << fileName << std::endl;
+        isPassed = false;
+    }
+
+    return isPassed;
+}
+
+// Returns the value of the flag and removes it from the arguments, so the benchmark library does not see it
+static bool ParseFlag(int& argc, char** argv, const char* flag, std::string& value)
+{
+    std::size_t length = std::strlen(flag);
+    for (int i = 1; i < argc; ++i)
+        if (std::strncmp(argv[i], flag, length) == 0 && (argv[i][length] == '=' || argv[i][length] == '\0'))
+        {
+            value = argv[i][length] == '=' ? argv[i] + length + 1 : "";
+            std::copy(argv + i + 1, argv + argc, argv + i);
+            --argc;
+            return true;
+        }
+
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    std::string stress, stressMilliseconds = "1000", baselineSave, baselineCheck, baselineTolerance = "0.1";
+    bool isStress = ParseFlag(argc, argv, "--stress", stress);
+    ParseFlag(argc, argv, "--stress_ms", stressMilliseconds);
+    bool isStressNotTimed = ParseFlag(argc, argv, "--stress_no_timed", stress);
+    bool isBaselineSave = ParseFlag(argc, argv, "--baseline_save", baselineSave);
+    bool isBaselineCheck = ParseFlag(argc, argv, "--baseline_check", baselineCheck);
+    ParseFlag(argc, argv, "--baseline_tolerance", baselineTolerance);
+
+    int milliseconds = 0;
+    double tolerance = 0;
+    if (!ParseNumber(stressMilliseconds, milliseconds) || milliseconds < 0)
+    {
+        std::cerr << "Wrong --stress_ms: " << stressMilliseconds << std::endl;
+        return 1;
+    }
+
+    if (!ParseNumber(baselineTolerance, tolerance) || tolerance < 0 || tolerance > 1)
+    {
+        std::cerr << "Wrong --baseline_tolerance: " << baselineTolerance << std::endl;
+        return 1;
+    }
+
+    if (isStress)
+        return StressAllLocks(std::chrono::milliseconds(milliseconds), !isStressNotTimed) ? 0 : 1;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    BaselineReporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+
+    if (isBaselineSave && !SaveBaseline(baselineSave, reporter.GetThroughputs()))
+    {
+        std::cerr << "Can not save the baseline " << baselineSave << std::endl;
+        return 1;
+    }
+
+    if (isBaselineCheck && !CheckBaseline(baselineCheck, reporter.GetThroughputs(), tolerance))
+        return 1;
+
+    return 0;
+}
@@ -2,7 +2,8 @@
 #include <mutex>
 #include <iostream>
 #include <atomic>
-#include <condition_variable>
+
+#include "CrossWalk.h"
 
 #if defined WIN32 || defined _WIN64
 #include <Windows.h>
@@ -14,85 +15,7 @@
 
 
 
-/**
-    \brief A class for synchronizing threads
-
-    The work of this class can be represented using a pedestrian crossing. 
-    For simplicity, you can imagine the work of this class on a two-lane road, 
-    but it can work with any number of roads. 
-    Cars can drive on two lanes of the same road completely independently of each other.  
-    At the same time, there is a pedestrian crossing on the road, and when a pedestrian approaches it, 
-    cars will no longer be able to enter the road, 
-    the pedestrian will wait until all the cars that were on the road when he came will finish their movement. 
-    After that, he will cross the road and cars will be able to move on the road again. 
-    Now let's move on to threads. You have a lot of threads that can run in parallel, 
-    i.e. they don't have to be synchronized with each other. 
-    And there is one thread that should only work when all other threads are not working. 
-    For example, when working with some container. For simplicity, 
-    let's imagine that we are working with a vector in which there are 2 elements. 
-    2 threads independently work with different elements of the vector. 
-    At the same time, you want to change the size of the vector. This class can help you with this. 
-    Working with reading and writing to vector cells is machines, and resizing a vector is a pedestrian
- */
-class ThreadCrossWalk
-{
-private:
-    std::mutex Mtx, RoadMtx;
-    std::atomic_int RoadCounter;
-    std::atomic_bool IsCondVarWaiting;
-    std::condition_variable Cv;
-public:
-    ThreadCrossWalk() 
-    { 
-        RoadCounter.store(0);
-        IsCondVarWaiting.store(false);
-    }
-
-    /// If the PedestrianStartCrossRoad method was called before, 
-    /// then this method will wait until the PedestrianStopCrossRoad method is called
-    void CarStartCrossRoad()
-    {
-        Mtx.lock();
-        RoadMtx.lock();
-        RoadCounter.fetch_add(1);
-        RoadMtx.unlock();
-        Mtx.unlock();
-    }
-
-    void CarStopCrossRoad()
-    {
-        RoadMtx.lock();
-        RoadCounter.fetch_sub(1);
-
-        if (RoadCounter.load() == 0)
-            while (IsCondVarWaiting.load()) Cv.notify_all();
-        
-        RoadMtx.unlock();
-    }
-
-    /// If the CarStartCrossRoad methods were called before, 
-    /// then this method will wait until the last of the CarStopCrossRoad methods is called
-    void PedestrianStartCrossRoad()
-    {
-        std::mutex mtx;
-        std::unique_lock<std::mutex> lk(mtx);
-
-        Mtx.lock();
-        
-        IsCondVarWaiting.store(true);
-
-        if (RoadCounter > 0) Cv.wait(lk);
-        
-        IsCondVarWaiting.store(false);
-    }
-
-    void PedestrianStopCrossRoad()
-    {
-        Mtx.unlock();
-    }
-};
-
-ThreadCrossWalk Wk;
+ThreadCrossWalk<> Wk;
 
 void Road1()
 {
@@ -156,4 +79,36 @@ int main()
     th4.join();
     th5.join();
     th6.join();
-}
\ No newline at end of file
+
+    // Pedestrian on the first road does not stop the cars on the second one
+    MultiRoadCrossWalk<2> roads;
+    roads.PedestrianStartCrossRoad(0);
+    roads.CarStartCrossRoad(1);
+    std::cout << "Car on the second road" << std::endl;
+    roads.CarStopCrossRoad(1);
+    roads.PedestrianStopCrossRoad(0);
+
+    roads.PedestrianStartCrossAllRoads();
+    std::cout << "Pedestrian crossing all roads" << std::endl;
+    roads.PedestrianStopCrossAllRoads();
+
+    // Threads change the different elements in parallel, and the growth stops them
+    ConcurrentVector<int> vec(2);
+    std::thread writer1([&vec]() { for (int i = 0; i < 1000; ++i) vec.Access(0, [](int& value) { ++value; }); });
+    std::thread writer2([&vec]() { for (int i = 0; i < 1000; ++i) vec.Access(1, [](int& value) { ++value; }); });
+    vec.PushBack(0);
+    writer1.join();
+    writer2.join();
+    std::cout << vec.Get(0) << " " << vec.Get(1) << " " << vec.Size() << std::endl;
+
+    // Car stays on the road for many items and lets the pedestrian cross between them
+    ThreadCrossWalk<> batchRoad;
+    std::thread batchPedestrian([&batchRoad]() { batchRoad.PedestrianStartCrossRoad(); batchRoad.PedestrianStopCrossRoad(); });
+    {
+        ReadSession<ThreadCrossWalk<>> session(batchRoad);
+        for (int i = 0; i < 1000; ++i)
+            session.Checkpoint();
+    }
+    batchPedestrian.join();
+    std::cout << "Pedestrian crossed" << std::endl;
+}
@@ -0,0 +1,706 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <shared_mutex>
+#include <type_traits>
+
+#include "LockCommon.h"
+
+/**
+    \brief A class for synchronizing threads
+
+    The work of this class can be represented using a pedestrian crossing. 
+    For simplicity, you can imagine the work of this class on a two-lane road, 
+    but it can work with any number of roads. 
+    Cars can drive on two lanes of the same road completely independently of each other.  
+    At the same time, there is a pedestrian crossing on the road, and when a pedestrian approaches it, 
+    cars will no longer be able to enter the road, 
+    the pedestrian will wait until all the cars that were on the road when he came will finish their movement. 
+    After that, he will cross the road and cars will be able to move on the road again. 
+    Now let's move on to threads. You have a lot of threads that can run in parallel, 
+    i.e. they don't have to be synchronized with each other. 
+    And there is one thread that should only work when all other threads are not working. 
+    For example, when working with some container. For simplicity, 
+    let's imagine that we are working with a vector in which there are 2 elements. 
+    2 threads independently work with different elements of the vector. 
+    At the same time, you want to change the size of the vector. This class can help you with this. 
+    Working with reading and writing to vector cells is machines, and resizing a vector is a pedestrian.
+    Who goes first when cars and pedestrians compete is set by the fairness policy from LockCommon.h,
+    where pedestrians are writers and cars are readers. By default pedestrians take precedence over the cars.
+    With BatchedWriterPolicy pedestrians that come together cross in limited batches with one stop of the traffic per batch.
+ */
+template <class FairnessPolicy = WriterPreferringPolicy>
+class ThreadCrossWalk
+{
+private:
+    static_assert(IsFairnessPolicy<FairnessPolicy> || IsBatchedWriterPolicy<FairnessPolicy>, "ThreadCrossWalk: unknown fairness policy");
+
+    static constexpr bool IsBatched = IsBatchedWriterPolicy<FairnessPolicy>;
+    static constexpr bool IsPedestrianPreferring = std::is_same<FairnessPolicy, WriterPreferringPolicy>::value || IsBatched;
+    static constexpr bool IsPhaseFair = std::is_same<FairnessPolicy, PhaseFairPolicy>::value;
+
+    // Lowest 32 bits of the road state store the amount of cars on the road.
+    // Next 31 bits store the amount of pedestrians waiting for the road. Every blocked pedestrian is counted there,
+    // so the counters are wide enough for any amount of threads and can not overflow into the neighbouring fields.
+    // The highest bit is set when a pedestrian is crossing the road.
+    static constexpr std::uint64_t CarMask = 0x00000000FFFFFFFFull;
+    static constexpr std::uint64_t WaitingPedestrian = 0x0000000100000000ull;
+    static constexpr std::uint64_t WaitingPedestrianMask = 0x7FFFFFFF00000000ull;
+    static constexpr std::uint64_t PedestrianBit = 0x8000000000000000ull;
+
+    // Packed road state: car counter, waiting pedestrians counter and pedestrian bit.
+    // Every car writes it, so it has its own cache line and the pedestrian fields are not invalidated by the cars
+    alignas(CacheLineSize) std::atomic<std::uint64_t> RoadState;
+
+    // Mutex to serialize pedestrians. This and the next fields are used only by the pedestrians and by the stopped cars
+    alignas(CacheLineSize) std::timed_mutex Mtx;
+
+    // Incremented each time when cars are let on the road after a pedestrian. Stopped cars wait on it
+    std::atomic<unsigned> RoadPhase;
+
+    // Amount of cars stopped by a pedestrian. Used only by the phase-fair and batched policies
+    std::atomic<unsigned> StoppedCars;
+
+    // Set when the stopped cars go between the pedestrian batches. Used only by the batched policy
+    std::atomic<unsigned> CarTurn;
+
+    // Amount of pedestrians in the current batch and the start time of the batch. Changed only by the pedestrian owning Mtx
+    unsigned BatchSize = 0;
+    std::chrono::steady_clock::time_point BatchStart;
+
+    // Spin-then-park strategies for stopped cars and for the pedestrian waiting for cars
+    AdaptiveWaiter CarWaiter, PedestrianWaiter;
+
+    // Statistics collector, where cars are reads and pedestrians are writes. Empty if LOCK_STATISTICS is not defined
+    [[no_unique_address]] LockStatistics Statistics;
+
+    // Checks if new cars have to wait with such road state
+    static constexpr bool IsCarStopped(std::uint64_t state)
+    {
+        if constexpr (std::is_same<FairnessPolicy, ReaderPreferringPolicy>::value)
+            return (state & PedestrianBit) != 0;
+        else
+            return (state & (PedestrianBit | WaitingPedestrianMask)) != 0;
+    }
+
+    // Checks if the stopped cars can go between the pedestrian batches
+    bool IsCarTurn(std::uint64_t state)
+    {
+        if constexpr (IsBatched)
+            return (state & PedestrianBit) == 0 && CarTurn.load(std::memory_order_seq_cst) != 0;
+        else
+            return false;
+    }
+
+    // Slow path of the car start. Called only when a pedestrian stops the cars
+    void CarStartCrossRoadSlow()
+    {
+        std::uint64_t waitStart = Statistics.Now();
+        bool isCounted = false;
+
+        for (;;)
+        {
+            std::uint64_t state = RoadState.load(std::memory_order_relaxed);
+            if (!IsCarStopped(state) || IsCarTurn(state))
+            {
+                if (RoadState.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    Statistics.OnContendedReadAcquire(waitStart, (state + 1) & CarMask);
+                    break;
+                }
+                continue;
+            }
+
+            // Register as a stopped car, so the next pedestrian let this car go first
+            if constexpr (IsPhaseFair || IsBatched)
+                if (!isCounted)
+                {
+                    StoppedCars.fetch_add(1, std::memory_order_seq_cst);
+                    isCounted = true;
+                    continue;
+                }
+
+            CarWaiter.Wait([this]()
+                {
+                    std::uint64_t state = RoadState.load(std::memory_order_seq_cst);
+                    return !IsCarStopped(state) || IsCarTurn(state);
+                },
+                [this]()
+                {
+                    // Phase is changed after the road state and the car turn, so if the pedestrian is still here, then wait can not miss the phase change
+                    unsigned phase = RoadPhase.load(std::memory_order_acquire);
+                    std::uint64_t state = RoadState.load(std::memory_order_seq_cst);
+                    if (IsCarStopped(state) && !IsCarTurn(state))
+                        RoadPhase.wait(phase, std::memory_order_acquire);
+                });
+        }
+
+        if constexpr (IsPhaseFair || IsBatched)
+            if (isCounted && StoppedCars.fetch_sub(1, std::memory_order_release) == 1)
+                StoppedCars.notify_one();
+    }
+
+    // Tries to set the pedestrian bit if there are no cars. Called only by the pedestrian owning Mtx
+    bool TrySetPedestrianBit()
+    {
+        std::uint64_t state = RoadState.load(std::memory_order_acquire);
+        while ((state & CarMask) == 0)
+            if (RoadState.compare_exchange_weak(state, state | PedestrianBit, std::memory_order_acquire, std::memory_order_acquire))
+                return true;
+
+        return false;
+    }
+
+    // Waits until the cars stopped by the previous pedestrian go. Used only by the phase-fair and batched policies
+    void WaitForStoppedCars()
+    {
+        PedestrianWaiter.Wait([this]() { return StoppedCars.load(std::memory_order_seq_cst) == 0; },
+            [this]()
+            {
+                unsigned stoppedCars = StoppedCars.load(std::memory_order_seq_cst);
+                if (stoppedCars != 0)
+                    StoppedCars.wait(stoppedCars, std::memory_order_acquire);
+            });
+    }
+
+    // Locks Mtx. Returns true if the mutex was held by another thread. It is checked only if statistics are enabled
+    bool LockMtx()
+    {
+        if constexpr (LockStatistics::IsEnabled)
+            if (Mtx.try_lock())
+                return false;
+
+        Mtx.lock();
+        return true;
+    }
+
+    // Waits until all cars leave the road and sets the pedestrian bit. Called only by the pedestrian owning Mtx.
+    // Returns true if the pedestrian had to wait
+    bool WaitForPedestrianBit()
+    {
+        if (TrySetPedestrianBit())
+            return false;
+
+        do
+            PedestrianWaiter.Wait([this]() { return (RoadState.load(std::memory_order_acquire) & CarMask) == 0; },
+                [this]()
+                {
+                    // Wait compares the road state atomically, so the wakeup from the last car cannot be lost
+                    std::uint64_t state = RoadState.load(std::memory_order_acquire);
+                    if ((state & CarMask) != 0)
+                        RoadState.wait(state, std::memory_order_acquire);
+                });
+        while (!TrySetPedestrianBit());
+
+        return true;
+    }
+
+    // Checks if the current pedestrian batch reached its limits. Called only by the pedestrian owning Mtx
+    bool IsBatchOver()
+    {
+        if constexpr (IsBatched)
+        {
+            if (BatchSize == 0)
+                return false;
+
+            if (BatchSize >= FairnessPolicy::MaxSize)
+                return true;
+
+            if constexpr (FairnessPolicy::MaxMicroseconds != 0)
+                return std::chrono::steady_clock::now() - BatchStart >= std::chrono::microseconds(FairnessPolicy::MaxMicroseconds);
+        }
+
+        return false;
+    }
+
+    // Lets the cars stopped during the batch go if the batch is over. Called only by the pedestrian owning Mtx.
+    // Function waitForCars waits until StoppedCars becomes zero and returns false if it gave up
+    template <class WaitForCars>
+    bool EndBatchIfOver(WaitForCars waitForCars)
+    {
+        if (!IsBatchOver())
+            return true;
+
+        if (StoppedCars.load(std::memory_order_seq_cst) != 0)
+        {
+            CarTurn.store(1, std::memory_order_seq_cst);
+            WakeStoppedCars();
+
+            bool isDone = waitForCars();
+            CarTurn.store(0, std::memory_order_seq_cst);
+
+            if (!isDone)
+                return false;
+        }
+
+        BatchSize = 0;
+        return true;
+    }
+
+    // Counts the pedestrian that got the road in the current batch. Called only by the pedestrian owning Mtx
+    void CountBatchPedestrian()
+    {
+        if constexpr (IsBatched)
+            if (BatchSize++ == 0 && FairnessPolicy::MaxMicroseconds != 0)
+                BatchStart = std::chrono::steady_clock::now();
+    }
+
+    // Lets go the cars stopped by the pedestrians
+    void WakeStoppedCars()
+    {
+        RoadPhase.fetch_add(1, std::memory_order_release);
+        RoadPhase.notify_all();
+    }
+
+    // Removes the pedestrian from the waiting pedestrians counter. Called when the timed pedestrian start gives up
+    void CancelWaitingPedestrian()
+    {
+        std::uint64_t state = RoadState.fetch_sub(WaitingPedestrian, std::memory_order_release) - WaitingPedestrian;
+        if (!IsCarStopped(state))
+            WakeStoppedCars();
+    }
+
+public:
+    ThreadCrossWalk() 
+    { 
+        RoadState.store(0);
+        RoadPhase.store(0);
+        StoppedCars.store(0);
+        CarTurn.store(0);
+    }
+
+    /// Sets the upper bound for spinning before the thread is parked.
+    /// Zero means to park at once
+    void SetMaxSpinLimit(unsigned maxSpinLimit)
+    {
+        CarWaiter.SetMaxSpinLimit(maxSpinLimit);
+        PedestrianWaiter.SetMaxSpinLimit(maxSpinLimit);
+    }
+
+    /// Returns the crosswalk statistics, where cars are reads and pedestrians are writes.
+    /// All zeros if LOCK_STATISTICS is not defined
+    LockStatisticsSnapshot GetStatistics() const
+    {
+        return Statistics.GetSnapshot();
+    }
+
+    /// If the PedestrianStartCrossRoad method was called before, 
+    /// then this method will wait until the PedestrianStopCrossRoad method is called
+    void CarStartCrossRoad()
+    {
+        std::uint64_t state = RoadState.load(std::memory_order_relaxed);
+        if (!IsCarStopped(state) && RoadState.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            Statistics.OnReadAcquire((state + 1) & CarMask);
+            return;
+        }
+
+        CarStartCrossRoadSlow();
+    }
+
+    /// Same as CarStartCrossRoad, but returns false instead of waiting for the pedestrian
+    bool TryCarStartCrossRoad()
+    {
+        std::uint64_t state = RoadState.load(std::memory_order_relaxed);
+        while (!IsCarStopped(state) || IsCarTurn(state))
+            if (RoadState.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                Statistics.OnReadAcquire((state + 1) & CarMask);
+                return true;
+            }
+
+        return false;
+    }
+
+    /// Same as CarStartCrossRoad, but returns false if the pedestrian is still crossing the road at the time point
+    template <class Clock, class Duration>
+    bool TryCarStartCrossRoadUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        return WaitUntil(timePoint, [this]() { return TryCarStartCrossRoad(); });
+    }
+
+    /// Same as CarStartCrossRoad, but returns false if the pedestrian is still crossing the road after the duration
+    template <class Rep, class Period>
+    bool TryCarStartCrossRoadFor(const std::chrono::duration<Rep, Period>& duration)
+    {
+        return TryCarStartCrossRoadUntil(std::chrono::steady_clock::now() + duration);
+    }
+
+    /// Returns true if a pedestrian waits for the road or crosses it. It costs one load,
+    /// so the cars that stay on the road for a long time can check it and let the pedestrian cross, for example with ReadSession
+    bool IsPedestrianWaiting() const
+    {
+        return (RoadState.load(std::memory_order_relaxed) & (WaitingPedestrianMask | PedestrianBit)) != 0;
+    }
+
+    void CarStopCrossRoad()
+    {
+        Statistics.OnReadRelease();
+
+        std::uint64_t prev = RoadState.fetch_sub(1, std::memory_order_release);
+
+        // Last car wakes up the pedestrian. Only the pedestrian owning Mtx waits on the road state
+        if ((prev & CarMask) == 1 && (prev & WaitingPedestrianMask) != 0)
+            RoadState.notify_one();
+    }
+
+    /// If the CarStartCrossRoad methods were called before, 
+    /// then this method will wait until the last of the CarStopCrossRoad methods is called
+    void PedestrianStartCrossRoad()
+    {
+        std::uint64_t waitStart = Statistics.Now();
+
+        // Pedestrian-preferring policy stops cars before the pedestrian gets Mtx, so pedestrians that wait for each other keep cars stopped
+        if constexpr (IsPedestrianPreferring)
+            RoadState.fetch_add(WaitingPedestrian, std::memory_order_relaxed);
+
+        bool isContended = LockMtx();
+
+        if constexpr (!IsPedestrianPreferring)
+        {
+            // Let go the cars stopped by the previous pedestrian
+            if constexpr (IsPhaseFair)
+                WaitForStoppedCars();
+
+            RoadState.fetch_add(WaitingPedestrian, std::memory_order_seq_cst);
+        }
+
+        // Let go the cars stopped during the previous batch
+        if constexpr (IsBatched)
+            EndBatchIfOver([this]() { WaitForStoppedCars(); return true; });
+
+        isContended = WaitForPedestrianBit() || isContended;
+        CountBatchPedestrian();
+        Statistics.OnWriteAcquire(waitStart, isContended);
+    }
+
+    /// Same as PedestrianStartCrossRoad, but returns false instead of waiting for the cars or another pedestrian
+    bool TryPedestrianStartCrossRoad()
+    {
+        if (!Mtx.try_lock())
+            return false;
+
+        if constexpr (IsPhaseFair)
+            if (StoppedCars.load(std::memory_order_seq_cst) != 0)
+            {
+                Mtx.unlock();
+                return false;
+            }
+
+        if constexpr (IsBatched)
+            if (IsBatchOver())
+            {
+                if (StoppedCars.load(std::memory_order_seq_cst) != 0)
+                {
+                    Mtx.unlock();
+                    return false;
+                }
+
+                BatchSize = 0;
+            }
+
+        std::uint64_t state = RoadState.load(std::memory_order_relaxed);
+        while ((state & CarMask) == 0)
+            if (RoadState.compare_exchange_weak(state, state + (WaitingPedestrian | PedestrianBit), std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                CountBatchPedestrian();
+                Statistics.OnWriteAcquire(Statistics.Now(), false);
+                return true;
+            }
+
+        Mtx.unlock();
+        return false;
+    }
+
+    /// Same as PedestrianStartCrossRoad, but returns false if the road is not free at the time point.
+    /// While waiting, cars are stopped the same way as in PedestrianStartCrossRoad
+    template <class Clock, class Duration>
+    bool TryPedestrianStartCrossRoadUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        if (TryPedestrianStartCrossRoad())
+            return true;
+
+        std::uint64_t waitStart = Statistics.Now();
+
+        if constexpr (IsPedestrianPreferring)
+            RoadState.fetch_add(WaitingPedestrian, std::memory_order_relaxed);
+
+        if (!Mtx.try_lock_until(timePoint))
+        {
+            if constexpr (IsPedestrianPreferring)
+                CancelWaitingPedestrian();
+            return false;
+        }
+
+        if constexpr (!IsPedestrianPreferring)
+        {
+            if constexpr (IsPhaseFair)
+                if (!WaitUntil(timePoint, [this]() { return StoppedCars.load(std::memory_order_seq_cst) == 0; }))
+                {
+                    Mtx.unlock();
+                    return false;
+                }
+
+            RoadState.fetch_add(WaitingPedestrian, std::memory_order_seq_cst);
+        }
+
+        if constexpr (IsBatched)
+            if (!EndBatchIfOver([&]() { return WaitUntil(timePoint, [this]() { return StoppedCars.load(std::memory_order_seq_cst) == 0; }); }))
+            {
+                CancelWaitingPedestrian();
+                Mtx.unlock();
+                return false;
+            }
+
+        if (WaitUntil(timePoint, [this]() { return TrySetPedestrianBit(); }))
+        {
+            CountBatchPedestrian();
+            Statistics.OnWriteAcquire(waitStart, true);
+            return true;
+        }
+
+        CancelWaitingPedestrian();
+        Mtx.unlock();
+        return false;
+    }
+
+    /// Same as PedestrianStartCrossRoad, but returns false if the road is not free after the duration
+    template <class Rep, class Period>
+    bool TryPedestrianStartCrossRoadFor(const std::chrono::duration<Rep, Period>& duration)
+    {
+        return TryPedestrianStartCrossRoadUntil(std::chrono::steady_clock::now() + duration);
+    }
+
+    void PedestrianStopCrossRoad()
+    {
+        Statistics.OnWriteRelease();
+
+        std::uint64_t state = RoadState.fetch_sub(PedestrianBit | WaitingPedestrian, std::memory_order_release) - (PedestrianBit | WaitingPedestrian);
+
+        // Nobody waits, so the cars go and the next pedestrian starts a new batch
+        if constexpr (IsBatched)
+            if (!IsCarStopped(state))
+                BatchSize = 0;
+
+        Mtx.unlock();
+
+        // Let go the stopped cars if there is no other pedestrian to stop them
+        if (!IsCarStopped(state))
+            WakeStoppedCars();
+    }
+
+    // std::shared_timed_mutex compatible names, so the crosswalk can be used with std::unique_lock and std::shared_lock.
+    // Pedestrian is the exclusive owner and cars are the shared owners
+    void lock() { PedestrianStartCrossRoad(); }
+    bool try_lock() { return TryPedestrianStartCrossRoad(); }
+    template <class Rep, class Period>
+    bool try_lock_for(const std::chrono::duration<Rep, Period>& duration) { return TryPedestrianStartCrossRoadFor(duration); }
+    template <class Clock, class Duration>
+    bool try_lock_until(const std::chrono::time_point<Clock, Duration>& timePoint) { return TryPedestrianStartCrossRoadUntil(timePoint); }
+    void unlock() { PedestrianStopCrossRoad(); }
+
+    void lock_shared() { CarStartCrossRoad(); }
+    bool try_lock_shared() { return TryCarStartCrossRoad(); }
+    template <class Rep, class Period>
+    bool try_lock_shared_for(const std::chrono::duration<Rep, Period>& duration) { return TryCarStartCrossRoadFor(duration); }
+    template <class Clock, class Duration>
+    bool try_lock_shared_until(const std::chrono::time_point<Clock, Duration>& timePoint) { return TryCarStartCrossRoadUntil(timePoint); }
+    void unlock_shared() { CarStopCrossRoad(); }
+};
+
+/**
+    \brief A crosswalk over several independent roads
+
+    Each road is a separate ThreadCrossWalk on its own cache lines, so cars on different roads do not share any state.
+    A pedestrian can cross one road, and then only the cars of that road wait, or all roads at once.
+    Pedestrians crossing all roads take the roads in ascending order, so they do not deadlock with each other or with single road pedestrians.
+    Use it when the data is split into independent partitions: one road per partition.
+
+    \tparam RoadsAmount amount of roads
+    \tparam FairnessPolicy fairness policy of the roads
+*/
+template <std::size_t RoadsAmount, class FairnessPolicy = WriterPreferringPolicy>
+class MultiRoadCrossWalk
+{
+private:
+    static_assert(RoadsAmount > 0, "MultiRoadCrossWalk: amount of roads must be positive");
+
+    // Crosswalks padded to whole cache lines, so neighbouring roads do not share a cache line
+    CacheAlignedArray<ThreadCrossWalk<FairnessPolicy>, RoadsAmount> Roads;
+
+public:
+    /// Returns the crosswalk of the road, for example to use it with std::shared_lock
+    ThreadCrossWalk<FairnessPolicy>& GetRoad(std::size_t road)
+    {
+        return Roads[road];
+    }
+
+    /// Sets the upper bound for spinning before the thread is parked on all roads.
+    /// Zero means to park at once
+    void SetMaxSpinLimit(unsigned maxSpinLimit)
+    {
+        for (std::size_t i = 0; i < RoadsAmount; ++i)
+            Roads[i].SetMaxSpinLimit(maxSpinLimit);
+    }
+
+    /// Same as ThreadCrossWalk::CarStartCrossRoad on the road
+    void CarStartCrossRoad(std::size_t road)
+    {
+        Roads[road].CarStartCrossRoad();
+    }
+
+    /// Same as ThreadCrossWalk::TryCarStartCrossRoad on the road
+    bool TryCarStartCrossRoad(std::size_t road)
+    {
+        return Roads[road].TryCarStartCrossRoad();
+    }
+
+    void CarStopCrossRoad(std::size_t road)
+    {
+        Roads[road].CarStopCrossRoad();
+    }
+
+    /// Stops only the cars of the road and waits until they leave it
+    void PedestrianStartCrossRoad(std::size_t road)
+    {
+        Roads[road].PedestrianStartCrossRoad();
+    }
+
+    /// Same as PedestrianStartCrossRoad, but returns false instead of waiting for the cars or another pedestrian
+    bool TryPedestrianStartCrossRoad(std::size_t road)
+    {
+        return Roads[road].TryPedestrianStartCrossRoad();
+    }
+
+    void PedestrianStopCrossRoad(std::size_t road)
+    {
+        Roads[road].PedestrianStopCrossRoad();
+    }
+
+    /// Stops the cars of all roads and waits until they leave them
+    void PedestrianStartCrossAllRoads()
+    {
+        for (std::size_t i = 0; i < RoadsAmount; ++i)
+            Roads[i].PedestrianStartCrossRoad();
+    }
+
+    /// Same as PedestrianStartCrossAllRoads, but returns false and frees the taken roads if any road is not free
+    bool TryPedestrianStartCrossAllRoads()
+    {
+        for (std::size_t i = 0; i < RoadsAmount; ++i)
+            if (!Roads[i].TryPedestrianStartCrossRoad())
+            {
+                while (i > 0)
+                    Roads[--i].PedestrianStopCrossRoad();
+                return false;
+            }
+
+        return true;
+    }
+
+    void PedestrianStopCrossAllRoads()
+    {
+        for (std::size_t i = RoadsAmount; i > 0; --i)
+            Roads[i - 1].PedestrianStopCrossRoad();
+    }
+};
+
+/**
+    \brief A vector from the ThreadCrossWalk example
+
+    Reading and writing the elements are cars, so threads work with the elements in parallel,
+    and the changes of the size are pedestrians, since they can move the elements to the new memory.
+    Threads that write elements with Set and Access must work with different elements, or the element type must be thread-safe, for example std::atomic.
+    Index out of range throws std::out_of_range, as std::vector::at does.
+    T can not be bool, since std::vector<bool> packs the elements into bits, so writes to the neighbouring elements would race.
+    Use char or another integer type instead.
+
+    \tparam T element type
+    \tparam FairnessPolicy fairness policy of the crosswalk
+*/
+template <class T, class FairnessPolicy = WriterPreferringPolicy>
+class ConcurrentVector
+{
+private:
+    static_assert(!std::is_same<T, bool>::value, "ConcurrentVector: std::vector<bool> elements are bits, so parallel writes to them race");
+
+    std::vector<T> Vec;
+
+    // Crosswalk is changed by the const methods
+    mutable ThreadCrossWalk<FairnessPolicy> Walk;
+
+public:
+    ConcurrentVector() {}
+
+    /// \brief Constructor
+    /// \param [in] size initial amount of elements
+    explicit ConcurrentVector(std::size_t size) : Vec(size) {}
+
+    ConcurrentVector(const ConcurrentVector&) = delete;
+    ConcurrentVector& operator=(const ConcurrentVector&) = delete;
+
+    std::size_t Size() const
+    {
+        std::shared_lock<ThreadCrossWalk<FairnessPolicy>> lk(Walk);
+        return Vec.size();
+    }
+
+    /// \brief Method for getting the copy of the element. It is a car
+    T Get(std::size_t index) const
+    {
+        std::shared_lock<ThreadCrossWalk<FairnessPolicy>> lk(Walk);
+        return Vec.at(index);
+    }
+
+    /// \brief Method for changing the element. It is a car
+    void Set(std::size_t index, const T& value)
+    {
+        std::shared_lock<ThreadCrossWalk<FairnessPolicy>> lk(Walk);
+        Vec.at(index) = value;
+    }
+
+    /// \brief Method for working with the element in place. It is a car
+    /// \param [in] index index of the element
+    /// \param [in] function function that gets T&
+    /// \return result of the function
+    template <class Function>
+    decltype(auto) Access(std::size_t index, Function function)
+    {
+        std::shared_lock<ThreadCrossWalk<FairnessPolicy>> lk(Walk);
+        return function(Vec.at(index));
+    }
+
+    /// \brief Method for reading all elements. It is a car
+    /// \param [in] function function that gets const T& of each element
+    template <class Function>
+    void ForEach(Function function) const
+    {
+        std::shared_lock<ThreadCrossWalk<FairnessPolicy>> lk(Walk);
+        for (const T& it : Vec)
+            function(it);
+    }
+
+    /// \brief Method for adding the element to the end. It is a pedestrian
+    void PushBack(const T& value)
+    {
+        std::unique_lock<ThreadCrossWalk<FairnessPolicy>> lk(Walk);
+        Vec.push_back(value);
+    }
+
+    /// \brief Method for changing the amount of elements. It is a pedestrian
+    void Resize(std::size_t size)
+    {
+        std::unique_lock<ThreadCrossWalk<FairnessPolicy>> lk(Walk);
+        Vec.resize(size);
+    }
+
+    /// \brief Method for reserving the memory, so the next PushBack calls do not move the elements. It is a pedestrian
+    void Reserve(std::size_t capacity)
+    {
+        std::unique_lock<ThreadCrossWalk<FairnessPolicy>> lk(Walk);
+        Vec.reserve(capacity);
+    }
+};
@@ -6,43 +6,9 @@
 
 #include <unistd.h>
 
-class ThreadCrossWalk
-{
-private:
-    std::mutex Mtx;
-    std::atomic_int AtomicCounter;
-
-public:
-    ThreadCrossWalk() 
-    {
-        AtomicCounter.store(0);
-    }
-
-    void CarStartCrossRoad()
-    {
-        Mtx.lock();
-        AtomicCounter.fetch_add(1);
-        Mtx.unlock();
-    }
+#include "CrossWalkLockFree.h"
 
-    void CarStopCrossRoad()
-    {
-        AtomicCounter.fetch_sub(1);
-    }
-
-    void PedestrianStartCrossRoad()
-    {
-        Mtx.lock();
-        while (AtomicCounter.load() != 0);
-    }
-
-    void PedestrianStopCrossRoad()
-    {
-        Mtx.unlock();
-    }
-};
-
-ThreadCrossWalk Wk;
+LockFreeThreadCrossWalk Wk;
 
 void Road1()
 {
@@ -106,4 +72,16 @@ int main()
         th4.join();
         // std::cout << i << std::endl;
     }
+
+    // Car stays on the road for many items and lets the pedestrian cross between them
+    std::thread batchPedestrian(Pedestrian);
+    {
+        ReadSession<LockFreeThreadCrossWalk> session(Wk);
+        for (int i = 0; i < 100; ++i)
+        {
+            usleep(100000);
+            session.Checkpoint();
+        }
+    }
+    batchPedestrian.join();
 }
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+#include "LockCommon.h"
+
+/**
+    \brief A class for synchronizing threads
+
+    The same crosswalk as ThreadCrossWalk from CrossWalk.h, but without any mutex.
+    The amount of cars and the pedestrian flag are packed into one atomic word, so a car enters the road with one compare and swap while no pedestrian is there,
+    and cars on different cores do not wait for each other.
+    A pedestrian claims the flag with a compare and swap, after that new cars wait, and the pedestrian waits for the cars on the road to leave.
+    Both cars and pedestrians wait with the spin-then-park strategy. Parked threads set a bit in the word,
+    so the last car and the leaving pedestrian wake them up only if somebody is parked.
+*/
+class LockFreeThreadCrossWalk
+{
+private:
+    // Layout of RoadState: the lower 30 bits are the amount of cars on the road,
+    // then the bit of the parked threads and the bit of the pedestrian on the road or waiting for the cars to leave
+    static constexpr unsigned CarMask = 0x3FFFFFFFu;
+    static constexpr unsigned ParkedBit = 0x40000000u;
+    static constexpr unsigned PedestrianBit = 0x80000000u;
+
+    // Cars and pedestrians state. Every car writes it, so it has its own cache line and the other fields are not invalidated by the cars
+    alignas(CacheLineSize) std::atomic<unsigned> RoadState;
+
+    // Spin-then-park strategy for the cars waiting for the pedestrian
+    alignas(CacheLineSize) AdaptiveWaiter CarWaiter;
+
+    // Spin-then-park strategy for the pedestrian waiting for cars or another pedestrian
+    AdaptiveWaiter PedestrianWaiter;
+
+    // Statistics collector, where cars are reads and pedestrians are writes. Empty if LOCK_STATISTICS is not defined
+    [[no_unique_address]] LockStatistics Statistics;
+
+    // Adds the car if there is no pedestrian. Returns the amount of cars with the new one or zero if the car can not enter
+    unsigned TryAddCar()
+    {
+        unsigned state = RoadState.load(std::memory_order_relaxed);
+        while ((state & PedestrianBit) == 0)
+            if (RoadState.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                return (state & CarMask) + 1;
+
+        return 0;
+    }
+
+    // Claims the pedestrian flag if there is no other pedestrian. Cars can still be on the road
+    bool TrySetPedestrianBit()
+    {
+        unsigned state = RoadState.load(std::memory_order_relaxed);
+        while ((state & PedestrianBit) == 0)
+            if (RoadState.compare_exchange_weak(state, state | PedestrianBit, std::memory_order_acquire, std::memory_order_relaxed))
+                return true;
+
+        return false;
+    }
+
+    bool IsRoadFree() const
+    {
+        return (RoadState.load(std::memory_order_acquire) & CarMask) == 0;
+    }
+
+    // Parks the thread until the state changes after setting the bit of the parked threads
+    void Park(unsigned state)
+    {
+        if ((state & ParkedBit) == 0 && !RoadState.compare_exchange_strong(state, state | ParkedBit, std::memory_order_relaxed))
+            return;
+
+        RoadState.wait(state | ParkedBit, std::memory_order_acquire);
+    }
+
+    // Wakes up the parked threads. Called after the change that can let them go
+    void WakeParked()
+    {
+        RoadState.fetch_and(~ParkedBit, std::memory_order_relaxed);
+        RoadState.notify_all();
+    }
+
+    // Clears the pedestrian flag and wakes up the parked cars and pedestrians
+    void ClearPedestrianBit()
+    {
+        if (RoadState.fetch_and(~PedestrianBit, std::memory_order_release) & ParkedBit)
+            WakeParked();
+    }
+
+public:
+    LockFreeThreadCrossWalk()
+    {
+        RoadState.store(0);
+    }
+
+    /// Sets the upper bound for spinning before the car or the pedestrian is parked.
+    /// Zero means to park at once
+    void SetMaxSpinLimit(unsigned maxSpinLimit)
+    {
+        CarWaiter.SetMaxSpinLimit(maxSpinLimit);
+        PedestrianWaiter.SetMaxSpinLimit(maxSpinLimit);
+    }
+
+    /// Returns the crosswalk statistics, where cars are reads and pedestrians are writes.
+    /// All zeros if LOCK_STATISTICS is not defined
+    LockStatisticsSnapshot GetStatistics() const
+    {
+        return Statistics.GetSnapshot();
+    }
+
+    /// Returns true if a pedestrian waits for the road or crosses it. It costs one load,
+    /// so the cars that stay on the road for a long time can check it and let the pedestrian cross, for example with ReadSession
+    bool IsPedestrianWaiting() const
+    {
+        return (RoadState.load(std::memory_order_relaxed) & PedestrianBit) != 0;
+    }
+
+    void CarStartCrossRoad()
+    {
+        unsigned cars = TryAddCar();
+        if (cars != 0)
+        {
+            Statistics.OnReadAcquire(cars);
+            return;
+        }
+
+        std::uint64_t waitStart = Statistics.Now();
+        CarWaiter.Wait([this, &cars]() { return (cars = TryAddCar()) != 0; },
+            [this]()
+            {
+                unsigned state = RoadState.load(std::memory_order_relaxed);
+                if (state & PedestrianBit)
+                    Park(state);
+            });
+        Statistics.OnContendedReadAcquire(waitStart, cars);
+    }
+
+    /// Same as CarStartCrossRoad, but returns false instead of waiting for the pedestrian
+    bool TryCarStartCrossRoad()
+    {
+        unsigned cars = TryAddCar();
+        if (cars == 0)
+            return false;
+
+        Statistics.OnReadAcquire(cars);
+        return true;
+    }
+
+    /// Same as CarStartCrossRoad, but returns false if the pedestrian is still crossing the road at the time point
+    template <class Clock, class Duration>
+    bool TryCarStartCrossRoadUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        if (TryCarStartCrossRoad())
+            return true;
+
+        std::uint64_t waitStart = Statistics.Now();
+        unsigned cars = 0;
+
+        if (!WaitUntil(timePoint, [this, &cars]() { return (cars = TryAddCar()) != 0; }))
+            return false;
+
+        Statistics.OnContendedReadAcquire(waitStart, cars);
+        return true;
+    }
+
+    /// Same as CarStartCrossRoad, but returns false if the pedestrian is still crossing the road after the duration
+    template <class Rep, class Period>
+    bool TryCarStartCrossRoadFor(const std::chrono::duration<Rep, Period>& duration)
+    {
+        return TryCarStartCrossRoadUntil(std::chrono::steady_clock::now() + duration);
+    }
+
+    void CarStopCrossRoad()
+    {
+        Statistics.OnReadRelease();
+
+        // Last car wakes up the pedestrian if he had to park
+        unsigned state = RoadState.fetch_sub(1, std::memory_order_release);
+        if ((state & CarMask) == 1 && (state & ParkedBit))
+            WakeParked();
+    }
+
+    void PedestrianStartCrossRoad()
+    {
+        std::uint64_t waitStart = Statistics.Now();
+        bool isContended = !TrySetPedestrianBit();
+
+        if (isContended)
+            PedestrianWaiter.Wait([this]() { return TrySetPedestrianBit(); },
+                [this]()
+                {
+                    unsigned state = RoadState.load(std::memory_order_relaxed);
+                    if (state & PedestrianBit)
+                        Park(state);
+                });
+
+        if constexpr (LockStatistics::IsEnabled)
+            isContended = !IsRoadFree() || isContended;
+
+        // New cars wait from now on, so only the cars already on the road are waited for
+        PedestrianWaiter.Wait([this]() { return IsRoadFree(); },
+            [this]()
+            {
+                unsigned state = RoadState.load(std::memory_order_relaxed);
+                if (state & CarMask)
+                    Park(state);
+            });
+
+        Statistics.OnWriteAcquire(waitStart, isContended);
+    }
+
+    /// Same as PedestrianStartCrossRoad, but returns false instead of waiting for the cars or another pedestrian
+    bool TryPedestrianStartCrossRoad()
+    {
+        unsigned state = 0;
+        if (!RoadState.compare_exchange_strong(state, PedestrianBit, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            // Only the parked threads bit can be set on the free road
+            if (state != ParkedBit || !RoadState.compare_exchange_strong(state, ParkedBit | PedestrianBit, std::memory_order_acquire, std::memory_order_relaxed))
+                return false;
+        }
+
+        Statistics.OnWriteAcquire(Statistics.Now(), false);
+        return true;
+    }
+
+    /// Same as PedestrianStartCrossRoad, but returns false if the road is not free at the time point
+    template <class Clock, class Duration>
+    bool TryPedestrianStartCrossRoadUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        if (TryPedestrianStartCrossRoad())
+            return true;
+
+        std::uint64_t waitStart = Statistics.Now();
+
+        if (!WaitUntil(timePoint, [this]() { return TrySetPedestrianBit(); }))
+            return false;
+
+        if (WaitUntil(timePoint, [this]() { return IsRoadFree(); }))
+        {
+            Statistics.OnWriteAcquire(waitStart, true);
+            return true;
+        }
+
+        // Cars waiting for this pedestrian can go
+        ClearPedestrianBit();
+        return false;
+    }
+
+    /// Same as PedestrianStartCrossRoad, but returns false if the road is not free after the duration
+    template <class Rep, class Period>
+    bool TryPedestrianStartCrossRoadFor(const std::chrono::duration<Rep, Period>& duration)
+    {
+        return TryPedestrianStartCrossRoadUntil(std::chrono::steady_clock::now() + duration);
+    }
+
+    void PedestrianStopCrossRoad()
+    {
+        Statistics.OnWriteRelease();
+        ClearPedestrianBit();
+    }
+
+    // std::shared_timed_mutex compatible names, so the crosswalk can be used with std::unique_lock and std::shared_lock.
+    // Pedestrian is the exclusive owner and cars are the shared owners
+    void lock() { PedestrianStartCrossRoad(); }
+    bool try_lock() { return TryPedestrianStartCrossRoad(); }
+    template <class Rep, class Period>
+    bool try_lock_for(const std::chrono::duration<Rep, Period>& duration) { return TryPedestrianStartCrossRoadFor(duration); }
+    template <class Clock, class Duration>
+    bool try_lock_until(const std::chrono::time_point<Clock, Duration>& timePoint) { return TryPedestrianStartCrossRoadUntil(timePoint); }
+    void unlock() { PedestrianStopCrossRoad(); }
+
+    void lock_shared() { CarStartCrossRoad(); }
+    bool try_lock_shared() { return TryCarStartCrossRoad(); }
+    template <class Rep, class Period>
+    bool try_lock_shared_for(const std::chrono::duration<Rep, Period>& duration) { return TryCarStartCrossRoadFor(duration); }
+    template <class Clock, class Duration>
+    bool try_lock_shared_until(const std::chrono::time_point<Clock, Duration>& timePoint) { return TryCarStartCrossRoadUntil(timePoint); }
+    void unlock_shared() { CarStopCrossRoad(); }
+};
@@ -0,0 +1,45 @@
+#include <thread>
+#include <iostream>
+#include <vector>
+
+#include "CrossWalkRcu.h"
+
+RcuThreadCrossWalk<std::vector<int>> Wk(new std::vector<int>(2, 1));
+
+void Road()
+{
+    for (int i = 0; i < 100000; ++i)
+    {
+        RcuThreadCrossWalk<std::vector<int>>::Car car(Wk);
+
+        int summ = 0;
+        for (const auto& it : *car)
+            summ += it;
+
+        if (summ != static_cast<int>(car->size()))
+            std::cout << "Error! Summ = " << summ << " Size: " << car->size() << std::endl;
+    }
+}
+
+void Pedestrian()
+{
+    // Resize does not stop the cars, they see either the old or the new vector
+    for (int i = 0; i < 1000; ++i)
+        Wk.PedestrianCrossRoad([](std::vector<int>& vec) { vec.resize(vec.size() + 1, 1); });
+}
+
+int main()
+{
+    std::thread th1(Road);
+    std::thread th2(Road);
+    std::thread th3(Road);
+    std::thread th4(Pedestrian);
+
+    th1.join();
+    th2.join();
+    th3.join();
+    th4.join();
+
+    RcuThreadCrossWalk<std::vector<int>>::Car car(Wk);
+    std::cout << "Size: " << car->size() << std::endl;
+}
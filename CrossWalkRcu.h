@@ -0,0 +1,249 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+#include "LockCommon.h"
+
+/**
+    \brief A crosswalk where the pedestrian never stops the cars
+
+    The road is an object of type T. Cars get the current version of the road and work with it without any locks.
+    Pedestrian does not wait for the cars: it makes a new version of the road, publishes it, and the old version is retired.
+    Retired versions are destroyed by the background thread after the grace period, when all cars that could see them have left the road.
+    So a car costs one atomic increment on its own cache line, and resizing the vector from the ThreadCrossWalk example does not stop anyone.
+    Cars must not change the road, since other cars see the same version.
+
+    Grace period detection uses two car counters per slot, as in sleepable RCU: a car counts itself in the counter of the current epoch,
+    and the grace period flips the epoch twice and waits until the counters of the previous epoch become zero.
+
+    \tparam T road type
+*/
+template <class T>
+class RcuThreadCrossWalk
+{
+private:
+    static constexpr std::size_t SlotsAmount = 64;
+
+    // Car counters of both epochs padded to the whole cache line
+    struct alignas(CacheLineSize) CarSlot
+    {
+        std::atomic<unsigned> Counters[2]{};
+    };
+
+    CarSlot Slots[SlotsAmount];
+
+    // Current version of the road
+    alignas(CacheLineSize) std::atomic<T*> Road;
+
+    // Epoch counter. Lowest bit is the index of the car counters for new cars
+    std::atomic<unsigned> Epoch;
+
+    // Mutex to serialize pedestrians
+    std::mutex Mtx;
+
+    // Mutex to serialize grace periods
+    std::mutex GracePeriodMtx;
+
+    // Queue of the retired callbacks and the background thread that calls them after the grace period
+    std::mutex RetiredMtx;
+    std::condition_variable RetiredCv;
+    std::vector<std::function<void()>> Retired;
+    bool IsStopped = false;
+    std::thread Reclaimer;
+
+    static std::size_t GetThreadSlotIndex()
+    {
+        static std::atomic<std::size_t> nextSlotIndex(0);
+        thread_local std::size_t slotIndex = nextSlotIndex.fetch_add(1, std::memory_order_relaxed) % SlotsAmount;
+        return slotIndex;
+    }
+
+    // Checks if all counters of the epoch index are zero
+    bool IsSlotsEmpty(unsigned epochIndex)
+    {
+        for (CarSlot& slot : Slots)
+            if (slot.Counters[epochIndex].load(std::memory_order_seq_cst) != 0)
+                return false;
+
+        return true;
+    }
+
+    // Flips the epoch and waits for the cars counted in the previous one. Called only by the thread owning GracePeriodMtx
+    void FlipEpoch()
+    {
+        unsigned epochIndex = Epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+
+        // Grace period is not latency critical, so the thread yields and then sleeps between the checks
+        std::chrono::microseconds pause(1);
+        for (int i = 0; !IsSlotsEmpty(epochIndex); ++i)
+        {
+            if (i < 64)
+                std::this_thread::yield();
+            else
+            {
+                std::this_thread::sleep_for(pause);
+                if (pause < std::chrono::milliseconds(1))
+                    pause *= 2;
+            }
+        }
+    }
+
+    // Calls retired callbacks after the grace period until the crosswalk is destroyed
+    void ReclaimerFunc()
+    {
+        std::unique_lock<std::mutex> lk(RetiredMtx);
+
+        for (;;)
+        {
+            RetiredCv.wait(lk, [this]() { return IsStopped || !Retired.empty(); });
+            if (Retired.empty())
+                return;
+
+            std::vector<std::function<void()>> retired;
+            retired.swap(Retired);
+            lk.unlock();
+
+            Synchronize();
+            for (std::function<void()>& callback : retired)
+                callback();
+
+            lk.lock();
+        }
+    }
+
+public:
+    /// \brief Guard for the car. Calls CarStartCrossRoad in the constructor and CarStopCrossRoad in the destructor
+    class Car
+    {
+    private:
+        RcuThreadCrossWalk& Walk;
+        unsigned EpochIndex;
+        const T* Road;
+
+    public:
+        /// \brief Constructor
+        /// \param [in] walk crosswalk to cross
+        Car(RcuThreadCrossWalk& walk) : Walk(walk)
+        {
+            EpochIndex = Walk.CarStartCrossRoad();
+            Road = Walk.GetRoad();
+        }
+
+        Car(const Car&) = delete;
+        Car& operator=(const Car&) = delete;
+
+        /// \return version of the road seen by the car
+        const T* operator->() const { return Road; }
+
+        /// \return version of the road seen by the car
+        const T& operator*() const { return *Road; }
+
+        ~Car()
+        {
+            Walk.CarStopCrossRoad(EpochIndex);
+        }
+    };
+
+    /// \brief Constructor
+    /// \param [in] road first version of the road. The crosswalk takes the ownership and destroys it with delete
+    explicit RcuThreadCrossWalk(T* road)
+    {
+        Road.store(road);
+        Epoch.store(0);
+        Reclaimer = std::thread(&RcuThreadCrossWalk::ReclaimerFunc, this);
+    }
+
+    RcuThreadCrossWalk(const RcuThreadCrossWalk&) = delete;
+    RcuThreadCrossWalk& operator=(const RcuThreadCrossWalk&) = delete;
+
+    /// \brief Starts the car crossing. The car never waits
+    /// \return epoch index that has to be given to CarStopCrossRoad
+    unsigned CarStartCrossRoad()
+    {
+        unsigned epochIndex = Epoch.load(std::memory_order_relaxed) & 1;
+
+        // Sequentially consistent increment is ordered with the road load, so either the grace period sees the car or the car sees the new road
+        Slots[GetThreadSlotIndex()].Counters[epochIndex].fetch_add(1, std::memory_order_seq_cst);
+        return epochIndex;
+    }
+
+    /// \brief Returns the current version of the road.
+    /// The version stays valid until CarStopCrossRoad, so it should be taken once per crossing
+    const T* GetRoad() const
+    {
+        return Road.load(std::memory_order_seq_cst);
+    }
+
+    /// \brief Stops the car crossing
+    /// \param [in] epochIndex epoch index from CarStartCrossRoad
+    void CarStopCrossRoad(unsigned epochIndex)
+    {
+        Slots[GetThreadSlotIndex()].Counters[epochIndex].fetch_sub(1, std::memory_order_release);
+    }
+
+    /// \brief Publishes the new version of the road. The old one is destroyed after the grace period
+    /// \param [in] road new version of the road. The crosswalk takes the ownership
+    void PublishRoad(T* road)
+    {
+        T* oldRoad = Road.exchange(road, std::memory_order_seq_cst);
+        Retire([oldRoad]() { delete oldRoad; });
+    }
+
+    /**
+        \brief Changes the copy of the road and publishes it
+
+        Pedestrians are serialized with each other, so changes are not lost, but cars are not stopped.
+
+        \param [in] change function that gets T& of the copy and changes it
+    */
+    template <class Function>
+    void PedestrianCrossRoad(Function change)
+    {
+        std::lock_guard<std::mutex> lk(Mtx);
+
+        T* road = new T(*Road.load(std::memory_order_relaxed));
+        change(*road);
+        PublishRoad(road);
+    }
+
+    /// \brief Queues the callback to be called by the background thread after the grace period
+    /// \param [in] callback function to call when no car can see the data retired before this call
+    void Retire(std::function<void()> callback)
+    {
+        {
+            std::lock_guard<std::mutex> lk(RetiredMtx);
+            Retired.emplace_back(std::move(callback));
+        }
+
+        RetiredCv.notify_one();
+    }
+
+    /// \brief Waits until all cars that started before this call stop. Must not be called by a car
+    void Synchronize()
+    {
+        std::lock_guard<std::mutex> lk(GracePeriodMtx);
+
+        // Car could take the epoch index before the first flip and count itself after it, so the second flip waits for such cars
+        FlipEpoch();
+        FlipEpoch();
+    }
+
+    /// \brief Destructor. Calls all retired callbacks and destroys the current road. There must be no cars on the road
+    ~RcuThreadCrossWalk()
+    {
+        {
+            std::lock_guard<std::mutex> lk(RetiredMtx);
+            IsStopped = true;
+        }
+
+        RetiredCv.notify_one();
+        Reclaimer.join();
+
+        delete Road.load();
+    }
+};
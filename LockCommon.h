@@ -0,0 +1,482 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+#if defined __x86_64__ || defined __i386__ || defined _M_X64 || defined _M_IX86
+#include <immintrin.h>
+#endif
+
+#include "LockStatistics.h"
+#include "LockOrderChecker.h"
+
+// Size of the cache line used to separate the fields written by readers from the fields written by writers and to separate the locks from each other.
+// It is a part of the object layout, so LOCK_CACHE_LINE_SIZE can be defined to the same value for all translation units, for example 128 for Apple M1.
+#if defined LOCK_CACHE_LINE_SIZE
+inline constexpr std::size_t CacheLineSize = LOCK_CACHE_LINE_SIZE;
+#elif defined __cpp_lib_hardware_interference_size
+#if defined __GNUC__ && !defined __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+inline constexpr std::size_t CacheLineSize = std::hardware_destructive_interference_size;
+#if defined __GNUC__ && !defined __clang__
+#pragma GCC diagnostic pop
+#endif
+#else
+inline constexpr std::size_t CacheLineSize = 64;
+#endif
+
+/**
+    \brief Array of objects where each object has its own cache lines
+
+    Locks placed next to each other in a usual array share cache lines, so a thread locking one lock slows down the threads locking its neighbours.
+    This array pads each object to the whole cache lines. It is useful for tables of small locks like CompactReadWriteMutex or std::shared_mutex.
+
+    \tparam T object type
+    \tparam N amount of objects
+*/
+template <class T, std::size_t N>
+class CacheAlignedArray
+{
+private:
+    struct alignas(CacheLineSize) Cell
+    {
+        T Value;
+    };
+
+    Cell Cells[N];
+
+public:
+    /// \brief Method for getting the object
+    /// \param [in] index index of the object
+    /// \return reference to the object
+    T& operator[](std::size_t index) { return Cells[index].Value; }
+
+    /// \brief Method for getting the object
+    /// \param [in] index index of the object
+    /// \return reference to the object
+    const T& operator[](std::size_t index) const { return Cells[index].Value; }
+
+    /// \return amount of objects
+    static constexpr std::size_t Size() { return N; }
+};
+
+/**
+    \brief Fairness policy in which writers take precedence over readers
+
+    As soon as a writer calls the write lock, no new readers enter the code section.
+    Writers that come one after another pass the code section without letting readers in between, so readers can starve under write bursts.
+    For ThreadCrossWalk pedestrians are writers and cars are readers.
+*/
+struct WriterPreferringPolicy {};
+
+/**
+    \brief Fairness policy in which readers take precedence over writers
+
+    Readers enter the code section at any time when there is no active writer, even if a writer is waiting.
+    The writer gets the code section only when there are no readers at all, so writers can starve under read load.
+    For ThreadCrossWalk pedestrians are writers and cars are readers.
+*/
+struct ReaderPreferringPolicy {};
+
+/**
+    \brief Phase-fair policy in which reader and writer phases alternate
+
+    A writer stops new readers like in WriterPreferringPolicy, but readers that were stopped by a writer
+    enter the code section before the next writer does. So neither readers nor writers can starve.
+    For ThreadCrossWalk pedestrians are writers and cars are readers.
+*/
+struct PhaseFairPolicy {};
+
+/**
+    \brief Writer-preferring policy in which waiting writers cross in batches
+
+    Writers that come while readers are stopped go one after another without letting readers in, like in WriterPreferringPolicy,
+    so the readers are drained once per batch instead of once per writer. When the batch reaches MaxBatchSize writers
+    or lasts MaxBatchMicroseconds, the readers stopped during the batch go before the next writer, so readers do not starve.
+    Supported only by ThreadCrossWalk, where pedestrians are writers and cars are readers.
+
+    \tparam MaxBatchSize maximum amount of writers in one batch
+    \tparam MaxBatchMicroseconds maximum duration of one batch. Zero means that the duration is not limited
+*/
+template <unsigned MaxBatchSize, unsigned MaxBatchMicroseconds = 0>
+struct BatchedWriterPolicy
+{
+    static_assert(MaxBatchSize > 0, "BatchedWriterPolicy: batch size must be positive");
+
+    static constexpr unsigned MaxSize = MaxBatchSize;
+    static constexpr unsigned MaxMicroseconds = MaxBatchMicroseconds;
+};
+
+/// \brief Checks that the type is BatchedWriterPolicy
+template <class FairnessPolicy>
+constexpr bool IsBatchedWriterPolicy = false;
+
+template <unsigned MaxBatchSize, unsigned MaxBatchMicroseconds>
+constexpr bool IsBatchedWriterPolicy<BatchedWriterPolicy<MaxBatchSize, MaxBatchMicroseconds>> = true;
+
+/// \brief Checks that the type is one of the fairness policies
+template <class FairnessPolicy>
+constexpr bool IsFairnessPolicy = std::is_same<FairnessPolicy, WriterPreferringPolicy>::value ||
+    std::is_same<FairnessPolicy, ReaderPreferringPolicy>::value ||
+    std::is_same<FairnessPolicy, PhaseFairPolicy>::value;
+
+/**
+    \brief Function for waiting with a timeout
+
+    Calls the predicate until it returns true or the time point is reached.
+    Between the calls the thread first yields, and then sleeps with an exponentially growing pause up to 1 millisecond.
+    It is used by the timed lock methods, since std::atomic::wait can not be used with a timeout.
+
+    \param [in] timePoint time point to wait until
+    \param [in] predicate function that returns true when the wait is over
+    \return true if the predicate returned true, false if the time point is reached
+*/
+template <class Clock, class Duration, class Predicate>
+bool WaitUntil(const std::chrono::time_point<Clock, Duration>& timePoint, Predicate predicate)
+{
+    std::chrono::microseconds pause(1);
+
+    for (int i = 0; ; ++i)
+    {
+        if (predicate())
+            return true;
+
+        auto now = Clock::now();
+        if (now >= timePoint)
+            return false;
+
+        if (i < 64)
+            std::this_thread::yield();
+        else
+        {
+            std::this_thread::sleep_for(std::min<typename Clock::duration>(pause, timePoint - now));
+            if (pause < std::chrono::milliseconds(1))
+                pause *= 2;
+        }
+    }
+}
+
+/// \brief Function to tell the processor that the thread is spinning
+inline void CpuRelax()
+{
+#if defined __x86_64__ || defined __i386__ || defined _M_X64 || defined _M_IX86
+    _mm_pause();
+#elif defined __aarch64__ || defined __arm__
+    __asm__ __volatile__("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+/**
+    \brief Class for adaptive spin-then-park waiting
+
+    The wait first spins with CpuRelax and exponentially growing pauses, and if the wait is not over, then it parks the thread.
+    The spin limit adapts to the observed wait times: if the wait ends while spinning, the limit moves towards twice the spent spins,
+    and if the thread has to park, the limit decreases. So short lock holds are waited by spinning, and long ones do not waste the core.
+    On single core machines the wait parks at once.
+*/
+class AdaptiveWaiter
+{
+private:
+    static constexpr unsigned MinSpinLimit = 16;
+    static constexpr unsigned MaxPause = 64;
+
+    // Current spin limit in CpuRelax calls
+    std::atomic<unsigned> SpinLimit;
+
+    // Upper bound for the spin limit
+    std::atomic<unsigned> MaxSpinLimit;
+
+    static bool IsSpinningUseful()
+    {
+        static const bool isSpinningUseful = std::thread::hardware_concurrency() > 1;
+        return isSpinningUseful;
+    }
+
+    // Moves the spin limit by 1/8 of the distance to the target
+    void AdaptSpinLimit(unsigned spinLimit, unsigned target)
+    {
+        int newSpinLimit = static_cast<int>(spinLimit) + (static_cast<int>(target) - static_cast<int>(spinLimit)) / 8;
+        int maxSpinLimit = static_cast<int>(MaxSpinLimit.load(std::memory_order_relaxed));
+        SpinLimit.store(static_cast<unsigned>(std::max(std::min(newSpinLimit, maxSpinLimit), static_cast<int>(MinSpinLimit))), std::memory_order_relaxed);
+    }
+
+public:
+    /// \brief Default upper bound for the spin limit in CpuRelax calls
+    static constexpr unsigned DefaultMaxSpinLimit = 4096;
+
+    /// \brief Default constructor
+    AdaptiveWaiter()
+    {
+        SpinLimit.store(MinSpinLimit * 8);
+        MaxSpinLimit.store(DefaultMaxSpinLimit);
+    }
+
+    /// \brief Method for setting the upper bound for the spin limit
+    /// \param [in] maxSpinLimit maximum amount of CpuRelax calls before parking. Zero means to park at once
+    void SetMaxSpinLimit(unsigned maxSpinLimit)
+    {
+        MaxSpinLimit.store(maxSpinLimit, std::memory_order_relaxed);
+        SpinLimit.store(std::min(SpinLimit.load(std::memory_order_relaxed), maxSpinLimit), std::memory_order_relaxed);
+    }
+
+    /**
+        \brief Method for waiting
+
+        \param [in] isDone function that returns true when the wait is over
+        \param [in] park function that parks the thread once, for example with std::atomic::wait.
+        It must not miss the event that makes isDone return true. Spurious returns are allowed
+    */
+    template <class Predicate, class Park>
+    void Wait(Predicate isDone, Park park)
+    {
+        if (isDone())
+            return;
+
+        unsigned spinLimit = SpinLimit.load(std::memory_order_relaxed);
+        if (IsSpinningUseful() && spinLimit != 0)
+        {
+            unsigned spins = 0;
+            for (unsigned pause = 1; spins < spinLimit; pause = std::min(pause * 2, MaxPause))
+            {
+                for (unsigned i = 0; i < pause; ++i)
+                    CpuRelax();
+                spins += pause;
+
+                if (isDone())
+                {
+                    AdaptSpinLimit(spinLimit, spins * 2);
+                    return;
+                }
+            }
+
+            AdaptSpinLimit(spinLimit, 0);
+        }
+
+        do
+            park();
+        while (!isDone());
+    }
+};
+
+/**
+    \brief Class to add std::shared_timed_mutex compatible methods to a lock class
+
+    Derived class must have ReadLock, ReadUnlock, TryReadLock, TryReadLockUntil,
+    WriteLock, WriteUnlock, TryWriteLock and TryWriteLockUntil methods.
+    This class adds TryReadLockFor and TryWriteLockFor methods and std::shared_timed_mutex names,
+    so the lock can be used with std::unique_lock and std::shared_lock.
+
+    \tparam Derived lock class
+*/
+template <class Derived>
+class SharedTimedMutexInterface
+{
+private:
+    Derived& Self() { return static_cast<Derived&>(*this); }
+
+public:
+    /// \brief Try to lock code section for reading during the duration
+    /// \param [in] duration maximum time to wait
+    /// \return true if locked, false otherwise
+    template <class Rep, class Period>
+    bool TryReadLockFor(const std::chrono::duration<Rep, Period>& duration LOCK_ORDER_SITE_NEXT_PARAMETER)
+    {
+        return try_lock_shared_until(std::chrono::steady_clock::now() + duration LOCK_ORDER_SITE_NEXT_ARGUMENT);
+    }
+
+    /// \brief Try to lock code section for writing during the duration
+    /// \param [in] duration maximum time to wait
+    /// \return true if locked, false otherwise
+    template <class Rep, class Period>
+    bool TryWriteLockFor(const std::chrono::duration<Rep, Period>& duration LOCK_ORDER_SITE_NEXT_PARAMETER)
+    {
+        return try_lock_until(std::chrono::steady_clock::now() + duration LOCK_ORDER_SITE_NEXT_ARGUMENT);
+    }
+
+    /// \brief Same as WriteLock
+    void lock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        // Place of the call is given to the lock classes checked by LockOrderChecker
+        if constexpr (requires { Self().WriteLock(LOCK_ORDER_SITE_ARGUMENT); })
+            Self().WriteLock(LOCK_ORDER_SITE_ARGUMENT);
+        else
+            Self().WriteLock();
+    }
+
+    /// \brief Same as TryWriteLock
+    bool try_lock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        if constexpr (requires { Self().TryWriteLock(LOCK_ORDER_SITE_ARGUMENT); })
+            return Self().TryWriteLock(LOCK_ORDER_SITE_ARGUMENT);
+        else
+            return Self().TryWriteLock();
+    }
+
+    /// \brief Same as TryWriteLockFor
+    template <class Rep, class Period>
+    bool try_lock_for(const std::chrono::duration<Rep, Period>& duration LOCK_ORDER_SITE_NEXT_PARAMETER)
+    {
+        return try_lock_until(std::chrono::steady_clock::now() + duration LOCK_ORDER_SITE_NEXT_ARGUMENT);
+    }
+
+    /// \brief Same as TryWriteLockUntil
+    template <class Clock, class Duration>
+    bool try_lock_until(const std::chrono::time_point<Clock, Duration>& timePoint LOCK_ORDER_SITE_NEXT_PARAMETER)
+    {
+        if constexpr (requires { Self().TryWriteLockUntil(timePoint LOCK_ORDER_SITE_NEXT_ARGUMENT); })
+            return Self().TryWriteLockUntil(timePoint LOCK_ORDER_SITE_NEXT_ARGUMENT);
+        else
+            return Self().TryWriteLockUntil(timePoint);
+    }
+
+    /// \brief Same as WriteUnlock
+    void unlock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        if constexpr (requires { Self().WriteUnlock(LOCK_ORDER_SITE_ARGUMENT); })
+            Self().WriteUnlock(LOCK_ORDER_SITE_ARGUMENT);
+        else
+            Self().WriteUnlock();
+    }
+
+    /// \brief Same as ReadLock
+    void lock_shared(LOCK_ORDER_SITE_PARAMETER)
+    {
+        if constexpr (requires { Self().ReadLock(LOCK_ORDER_SITE_ARGUMENT); })
+            Self().ReadLock(LOCK_ORDER_SITE_ARGUMENT);
+        else
+            Self().ReadLock();
+    }
+
+    /// \brief Same as TryReadLock
+    bool try_lock_shared(LOCK_ORDER_SITE_PARAMETER)
+    {
+        if constexpr (requires { Self().TryReadLock(LOCK_ORDER_SITE_ARGUMENT); })
+            return Self().TryReadLock(LOCK_ORDER_SITE_ARGUMENT);
+        else
+            return Self().TryReadLock();
+    }
+
+    /// \brief Same as TryReadLockFor
+    template <class Rep, class Period>
+    bool try_lock_shared_for(const std::chrono::duration<Rep, Period>& duration LOCK_ORDER_SITE_NEXT_PARAMETER)
+    {
+        return try_lock_shared_until(std::chrono::steady_clock::now() + duration LOCK_ORDER_SITE_NEXT_ARGUMENT);
+    }
+
+    /// \brief Same as TryReadLockUntil
+    template <class Clock, class Duration>
+    bool try_lock_shared_until(const std::chrono::time_point<Clock, Duration>& timePoint LOCK_ORDER_SITE_NEXT_PARAMETER)
+    {
+        if constexpr (requires { Self().TryReadLockUntil(timePoint LOCK_ORDER_SITE_NEXT_ARGUMENT); })
+            return Self().TryReadLockUntil(timePoint LOCK_ORDER_SITE_NEXT_ARGUMENT);
+        else
+            return Self().TryReadLockUntil(timePoint);
+    }
+
+    /// \brief Same as ReadUnlock
+    void unlock_shared(LOCK_ORDER_SITE_PARAMETER)
+    {
+        if constexpr (requires { Self().ReadUnlock(LOCK_ORDER_SITE_ARGUMENT); })
+            Self().ReadUnlock(LOCK_ORDER_SITE_ARGUMENT);
+        else
+            Self().ReadUnlock();
+    }
+};
+
+/**
+    \brief Read lock for a batch of short read sections
+
+    Instead of locking the mutex for every item of the batch, the session locks it for reading once and keeps it between the items.
+    Between the items the thread calls Checkpoint, which costs one load while no writer waits.
+    Only when a writer is actually waiting, the session unlocks the mutex, lets the writer in and locks the mutex again,
+    so the writer waits at most one item instead of the whole batch.
+    After Checkpoint returned true the data could be changed by the writer, so pointers and iterators taken before it must be taken again.
+    The lock must have the IsWriterWaiting method, like the mutexes from ReadWriteMutex.h, or the IsPedestrianWaiting method, like ThreadCrossWalk from CrossWalk.h.
+
+    \code
+    ReadSession<ReadWriteMutex<>> session(rwmx);
+    for (std::size_t i = 0; i < items.size(); ++i)
+    {
+        Process(items[i]);
+        session.Checkpoint();
+    }
+    \endcode
+
+    \tparam Mutex lock type
+*/
+template <class Mutex>
+class ReadSession
+{
+private:
+    static_assert(requires(const Mutex& mtx) { mtx.IsWriterWaiting(); } || requires(const Mutex& mtx) { mtx.IsPedestrianWaiting(); },
+        "ReadSession: the lock must have the IsWriterWaiting or the IsPedestrianWaiting method");
+
+    Mutex& Mtx;
+
+    // Amount of times the session let writers in
+    std::size_t YieldsAmount = 0;
+
+public:
+    /// \brief Constructor. Locks the mutex for reading
+    /// \param [in] mtx mutex to lock
+    explicit ReadSession(Mutex& mtx) : Mtx(mtx)
+    {
+        Mtx.lock_shared();
+    }
+
+    ReadSession(const ReadSession&) = delete;
+    ReadSession& operator=(const ReadSession&) = delete;
+
+    /// \brief A method for checking if a writer waits for the mutex. It costs one load
+    /// \return true if a writer waits
+    bool IsWriterWaiting() const
+    {
+        if constexpr (requires { Mtx.IsWriterWaiting(); })
+            return Mtx.IsWriterWaiting();
+        else
+            return Mtx.IsPedestrianWaiting();
+    }
+
+    /**
+        \brief A method for letting in the waiting writer between the items of the batch
+
+        If no writer waits, it does nothing. Otherwise it unlocks the mutex, gives the processor to the writer and locks the mutex for reading again.
+
+        \return true if the mutex was unlocked, so the data could be changed and pointers to it must be taken again
+    */
+    bool Checkpoint()
+    {
+        if (!IsWriterWaiting())
+            return false;
+
+        Mtx.unlock_shared();
+        // Reader preferring locks let the reader in again at once, so the writer gets a chance to take the mutex first
+        std::this_thread::yield();
+        Mtx.lock_shared();
+
+        ++YieldsAmount;
+        return true;
+    }
+
+    /// \brief A method for getting the amount of times the session let writers in
+    /// \return amount of the Checkpoint calls that returned true
+    std::size_t GetYieldsAmount() const
+    {
+        return YieldsAmount;
+    }
+
+    /// \brief Destructor. Unlocks the mutex
+    ~ReadSession()
+    {
+        Mtx.unlock_shared();
+    }
+};
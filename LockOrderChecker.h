@@ -0,0 +1,294 @@
+#pragma once
+
+#ifdef LOCK_ORDER_CHECKING
+
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <source_location>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// \brief Place in the code where the lock was taken
+using LockSite = std::source_location;
+
+// Parameter of the lock methods with the place of the call, the value to give to the checker and the argument to give to another lock method
+#define LOCK_ORDER_SITE_PARAMETER LockSite site = LockSite::current()
+#define LOCK_ORDER_SITE site
+#define LOCK_ORDER_SITE_ARGUMENT site
+
+// Same parameter and argument for the methods that have other parameters before it
+#define LOCK_ORDER_SITE_NEXT_PARAMETER , LockSite site = LockSite::current()
+#define LOCK_ORDER_SITE_NEXT_ARGUMENT , site
+
+/**
+    \brief Lock order checker for the debug builds
+
+    Enabled when LOCK_ORDER_CHECKING is defined. Each thread keeps the stack of the locks it holds with the places where they were taken.
+    When a thread waits for a lock while holding other locks, the edges from the held locks to the new one are added to the global lock order graph.
+    If the new edge makes a cycle, then two threads can take the locks in different orders and deadlock, so the cycle is reported with the places of all its edges.
+    Locks of the mutex already held by the thread for non-recursive mutexes, unlocks of the mutex not held by the thread and unlocks with the wrong mode are reported too.
+    Reports go to std::cerr by default, SetReportHandler sets another handler, for example to abort.
+    The checker is slow and takes a global mutex on each lock, so it is only for the debug builds.
+*/
+class LockOrderChecker
+{
+private:
+    struct HeldLock
+    {
+        const void* Lock;
+        bool IsWrite;
+        LockSite Site;
+    };
+
+    // Places of the two locks of the edge: held lock and the lock taken after it
+    struct Edge
+    {
+        LockSite FromSite;
+        LockSite ToSite;
+    };
+
+    struct Graph
+    {
+        std::mutex Mtx;
+        std::unordered_map<const void*, std::unordered_map<const void*, Edge>> Edges;
+        std::function<void(const std::string&)> ReportHandler;
+    };
+
+    static Graph& GetGraph()
+    {
+        static Graph graph;
+        return graph;
+    }
+
+    static std::vector<HeldLock>& GetLocalThreadHeldLocks()
+    {
+        thread_local std::vector<HeldLock> heldLocks;
+        return heldLocks;
+    }
+
+    static std::string FormatLock(const void* lock)
+    {
+        std::ostringstream stream;
+        stream << lock;
+        return stream.str();
+    }
+
+    static std::string FormatSite(const LockSite& site)
+    {
+        std::ostringstream stream;
+        stream << site.file_name() << ":" << site.line() << " in " << site.function_name();
+        return stream.str();
+    }
+
+    // Finds the path of edges from one lock to another. Called only with the graph mutex locked
+    static bool FindPath(Graph& graph, const void* from, const void* to, std::vector<const void*>& path)
+    {
+        std::unordered_map<const void*, const void*> previous{ { from, nullptr } };
+        std::vector<const void*> stack{ from };
+
+        while (!stack.empty())
+        {
+            const void* lock = stack.back();
+            stack.pop_back();
+
+            if (lock == to)
+            {
+                for (const void* it = to; it != nullptr; it = previous[it])
+                    path.insert(path.begin(), it);
+                return true;
+            }
+
+            auto edges = graph.Edges.find(lock);
+            if (edges == graph.Edges.end())
+                continue;
+
+            for (const auto& [next, edge] : edges->second)
+                if (previous.emplace(next, lock).second)
+                    stack.push_back(next);
+        }
+
+        return false;
+    }
+
+public:
+    static constexpr bool IsEnabled = true;
+
+    /// \brief Method for setting the handler of the reports
+    /// \param [in] handler function that gets the report. Empty function means std::cerr
+    static void SetReportHandler(std::function<void(const std::string&)> handler)
+    {
+        Graph& graph = GetGraph();
+        std::lock_guard<std::mutex> lk(graph.Mtx);
+        graph.ReportHandler = std::move(handler);
+    }
+
+    /// \brief Method for reporting the misuse of the lock
+    /// \param [in] message report text
+    static void Report(const std::string& message)
+    {
+        Graph& graph = GetGraph();
+        std::function<void(const std::string&)> handler;
+        {
+            std::lock_guard<std::mutex> lk(graph.Mtx);
+            handler = graph.ReportHandler;
+        }
+
+        if (handler)
+            handler(message);
+        else
+            std::cerr << "LockOrderChecker: " << message << std::endl;
+    }
+
+    /// \brief Method to call before waiting for the lock
+    /// \param [in] lock address of the lock
+    /// \param [in] isWrite true for the write lock
+    /// \param [in] isRecursive true if the thread can lock the lock again
+    /// \param [in] site place of the lock
+    static void OnAcquire(const void* lock, bool isWrite, bool isRecursive, const LockSite& site)
+    {
+        std::vector<HeldLock>& heldLocks = GetLocalThreadHeldLocks();
+        std::vector<std::string> reports;
+
+        for (const HeldLock& held : heldLocks)
+            if (held.Lock == lock && !isRecursive)
+                reports.push_back(std::string(isWrite ? "write" : "read") + " lock of " + (held.IsWrite ? "write" : "read") +
+                    " locked mutex " + FormatLock(lock) + " at " + FormatSite(site) +
+                    ", it was locked at " + FormatSite(held.Site));
+
+        {
+            Graph& graph = GetGraph();
+            std::lock_guard<std::mutex> lk(graph.Mtx);
+
+            for (const HeldLock& held : heldLocks)
+            {
+                if (held.Lock == lock || !graph.Edges[held.Lock].emplace(lock, Edge{ held.Site, site }).second)
+                    continue;
+
+                // New edge from the held lock to this one closes a cycle if this lock was taken before the held one somewhere
+                std::vector<const void*> path;
+                if (!FindPath(graph, lock, held.Lock, path))
+                    continue;
+
+                std::string report = "lock order inversion: mutex " + FormatLock(lock) + " locked at " + FormatSite(site) +
+                    " while holding mutex " + FormatLock(held.Lock) + " locked at " + FormatSite(held.Site) + ", but";
+                for (std::size_t i = 0; i + 1 < path.size(); ++i)
+                {
+                    const Edge& edge = graph.Edges[path[i]][path[i + 1]];
+                    report += " mutex " + FormatLock(path[i + 1]) + " was locked at " + FormatSite(edge.ToSite) +
+                        " while holding mutex " + FormatLock(path[i]) + " locked at " + FormatSite(edge.FromSite) + ";";
+                }
+                reports.push_back(report);
+            }
+        }
+
+        heldLocks.push_back(HeldLock{ lock, isWrite, site });
+
+        for (const std::string& report : reports)
+            Report(report);
+    }
+
+    /// \brief Method to call after the successful try lock. Try locks do not wait, so they do not add edges to the graph
+    /// \param [in] lock address of the lock
+    /// \param [in] isWrite true for the write lock
+    /// \param [in] site place of the lock
+    static void OnTryAcquire(const void* lock, bool isWrite, const LockSite& site)
+    {
+        GetLocalThreadHeldLocks().push_back(HeldLock{ lock, isWrite, site });
+    }
+
+    /// \brief Method to call after the unsuccessful lock that was announced with OnAcquire
+    /// \param [in] lock address of the lock
+    static void OnAcquireFailed(const void* lock)
+    {
+        std::vector<HeldLock>& heldLocks = GetLocalThreadHeldLocks();
+        for (std::size_t i = heldLocks.size(); i > 0; --i)
+            if (heldLocks[i - 1].Lock == lock)
+            {
+                heldLocks.erase(heldLocks.begin() + static_cast<std::ptrdiff_t>(i - 1));
+                return;
+            }
+    }
+
+    /// \brief Method to call before the unlock
+    /// \param [in] lock address of the lock
+    /// \param [in] isWrite true for the write unlock
+    /// \param [in] site place of the unlock
+    static void OnRelease(const void* lock, bool isWrite, const LockSite& site)
+    {
+        std::vector<HeldLock>& heldLocks = GetLocalThreadHeldLocks();
+        for (std::size_t i = heldLocks.size(); i > 0; --i)
+            if (heldLocks[i - 1].Lock == lock)
+            {
+                bool isHeldWrite = heldLocks[i - 1].IsWrite;
+                heldLocks.erase(heldLocks.begin() + static_cast<std::ptrdiff_t>(i - 1));
+
+                if (isHeldWrite != isWrite)
+                    Report(std::string(isWrite ? "write" : "read") + " unlock of " + (isHeldWrite ? "write" : "read") + " locked mutex " +
+                        FormatLock(lock) + " at " + FormatSite(site));
+                return;
+            }
+
+        Report(std::string(isWrite ? "write" : "read") + " unlock of the mutex " + FormatLock(lock) +
+            " not locked by this thread at " + FormatSite(site));
+    }
+
+    /// \brief Method to call when the held lock changes the mode, for example on the upgrade or the downgrade
+    /// \param [in] lock address of the lock
+    /// \param [in] isWrite true if the lock becomes the write lock
+    static void OnConvert(const void* lock, bool isWrite)
+    {
+        std::vector<HeldLock>& heldLocks = GetLocalThreadHeldLocks();
+        for (std::size_t i = heldLocks.size(); i > 0; --i)
+            if (heldLocks[i - 1].Lock == lock)
+            {
+                heldLocks[i - 1].IsWrite = isWrite;
+                return;
+            }
+    }
+
+    /// \brief Method to call from the destructor of the lock, so the new lock at the same address does not get its edges
+    /// \param [in] lock address of the lock
+    static void OnDestroy(const void* lock)
+    {
+        Graph& graph = GetGraph();
+        std::lock_guard<std::mutex> lk(graph.Mtx);
+
+        graph.Edges.erase(lock);
+        for (auto& [from, edges] : graph.Edges)
+            edges.erase(lock);
+    }
+};
+
+#else
+
+/// \brief Empty place of the lock
+struct LockSite {};
+
+#define LOCK_ORDER_SITE_PARAMETER
+#define LOCK_ORDER_SITE LockSite()
+#define LOCK_ORDER_SITE_ARGUMENT
+#define LOCK_ORDER_SITE_NEXT_PARAMETER
+#define LOCK_ORDER_SITE_NEXT_ARGUMENT
+
+/// \brief Lock order checker that does nothing. Used when LOCK_ORDER_CHECKING is not defined
+class LockOrderChecker
+{
+public:
+    static constexpr bool IsEnabled = false;
+
+    template <class Handler>
+    static void SetReportHandler(const Handler&) {}
+    static void Report(const char*) {}
+    static void OnAcquire(const void*, bool, bool, LockSite) {}
+    static void OnTryAcquire(const void*, bool, LockSite) {}
+    static void OnAcquireFailed(const void*) {}
+    static void OnRelease(const void*, bool, LockSite) {}
+    static void OnConvert(const void*, bool) {}
+    static void OnDestroy(const void*) {}
+};
+
+#endif
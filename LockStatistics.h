@@ -0,0 +1,407 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+/**
+    \brief Snapshot of the lock statistics
+
+    Histograms have power of two buckets: bucket i counts the times from 2^(i-1) to 2^i nanoseconds, bucket 0 counts zero times.
+    Hold times of read locks are sampled, so the read hold histogram counts only every LockStatistics::ReadHoldSamplingPeriod-th read lock of a thread.
+*/
+struct LockStatisticsSnapshot
+{
+    static constexpr std::size_t HistogramBucketsAmount = 40;
+    using Histogram = std::array<std::uint64_t, HistogramBucketsAmount>;
+
+    std::uint64_t ReadAcquisitions = 0;
+    std::uint64_t WriteAcquisitions = 0;
+    std::uint64_t ContendedReadAcquisitions = 0;
+    std::uint64_t ContendedWriteAcquisitions = 0;
+
+    // Amount of write locks that waited longer than LockStatistics::WriterStarvationThreshold
+    std::uint64_t WriterStarvationEvents = 0;
+
+    // Maximum amount of readers inside the code section at the same time
+    std::uint64_t MaxReaders = 0;
+
+    Histogram ReadWaitHistogram{};
+    Histogram WriteWaitHistogram{};
+    Histogram ReadHoldHistogram{};
+    Histogram WriteHoldHistogram{};
+};
+
+#ifdef LOCK_STATISTICS
+
+#ifndef LOCK_STATISTICS_WRITER_STARVATION_NS
+#define LOCK_STATISTICS_WRITER_STARVATION_NS 1000000
+#endif
+
+/**
+    \brief Lock statistics collector
+
+    Enabled when LOCK_STATISTICS is defined. The lock holds only a pointer to the registry of the counters, which is allocated on the first event.
+    Each thread that uses the lock gets its own buffer of counters in the registry and writes only to it,
+    so the statistics do not add shared cache lines to the lock. GetSnapshot sums the buffers of all threads.
+    A buffer is owned by both the registry and the thread, and the last owner deletes it, so the counters of the finished threads are kept
+    and the threads do not keep the buffers of the destroyed locks.
+    Uncontended read locks do not read the clock, except for sampled hold time measurements.
+*/
+class LockStatistics
+{
+private:
+    static constexpr std::size_t HeldReadLocksAmount = 16;
+    static constexpr std::size_t MinThreadBuffersSweepSize = 16;
+
+    // Counters of one thread. Written only by this thread
+    struct alignas(64) Buffer
+    {
+        std::atomic<std::uint64_t> ReadAcquisitions{0};
+        std::atomic<std::uint64_t> WriteAcquisitions{0};
+        std::atomic<std::uint64_t> ContendedReadAcquisitions{0};
+        std::atomic<std::uint64_t> ContendedWriteAcquisitions{0};
+        std::atomic<std::uint64_t> WriterStarvationEvents{0};
+
+        std::atomic<std::uint64_t> ReadWaitHistogram[LockStatisticsSnapshot::HistogramBucketsAmount]{};
+        std::atomic<std::uint64_t> WriteWaitHistogram[LockStatisticsSnapshot::HistogramBucketsAmount]{};
+        std::atomic<std::uint64_t> ReadHoldHistogram[LockStatisticsSnapshot::HistogramBucketsAmount]{};
+        std::atomic<std::uint64_t> WriteHoldHistogram[LockStatisticsSnapshot::HistogramBucketsAmount]{};
+
+        // Next buffer of the registry
+        Buffer* Next = nullptr;
+
+        // The registry and the thread. One owner means that the other one is gone
+        std::atomic<int> OwnersAmount{2};
+    };
+
+    // Counters of one lock
+    struct Registry
+    {
+        // List of the buffers of all threads. Buffers are only added
+        std::atomic<Buffer*> Buffers{nullptr};
+
+        std::atomic<std::uint64_t> MaxReaders{0};
+
+        // Time when the current writer got the lock. Written only by the writer
+        std::uint64_t WriteAcquireTime = 0;
+
+        ~Registry()
+        {
+            Buffer* buffer = Buffers.load(std::memory_order_acquire);
+            while (buffer != nullptr)
+            {
+                Buffer* next = buffer->Next;
+                ReleaseBuffer(buffer);
+                buffer = next;
+            }
+        }
+    };
+
+    // Buffers of the current thread by registry
+    struct ThreadBuffers
+    {
+        std::unordered_map<const Registry*, Buffer*> Buffers;
+
+        // Last used buffer, so the lookup of the same lock does not touch the map
+        const Registry* LastRegistry = nullptr;
+        Buffer* LastBuffer = nullptr;
+
+        // Size of the map after which the buffers of the destroyed locks are removed
+        std::size_t SweepSize = MinThreadBuffersSweepSize;
+
+        ~ThreadBuffers()
+        {
+            for (auto& [registry, buffer] : Buffers)
+                ReleaseBuffer(buffer);
+        }
+    };
+
+    // Read locks of the current thread whose hold time is measured
+    struct HeldReadLock
+    {
+        const LockStatistics* Statistics;
+        std::uint64_t AcquireTime;
+    };
+
+    struct HeldReadLocks
+    {
+        HeldReadLock Locks[HeldReadLocksAmount];
+        std::size_t Size = 0;
+        unsigned SamplingCounter = 0;
+    };
+
+    // Allocated on the first event
+    std::atomic<Registry*> Data{nullptr};
+
+    static void ReleaseBuffer(Buffer* buffer)
+    {
+        if (buffer->OwnersAmount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete buffer;
+    }
+
+    static bool IsOrphaned(const Buffer* buffer)
+    {
+        return buffer->OwnersAmount.load(std::memory_order_acquire) == 1;
+    }
+
+    static HeldReadLocks& GetLocalThreadHeldReadLocks()
+    {
+        thread_local HeldReadLocks heldReadLocks;
+        return heldReadLocks;
+    }
+
+    static ThreadBuffers& GetLocalThreadBuffers()
+    {
+        thread_local ThreadBuffers threadBuffers;
+        return threadBuffers;
+    }
+
+    // Removes the buffers of the destroyed locks from the map of the current thread
+    static void SweepThreadBuffers(ThreadBuffers& threadBuffers)
+    {
+        for (auto it = threadBuffers.Buffers.begin(); it != threadBuffers.Buffers.end();)
+            if (IsOrphaned(it->second))
+            {
+                ReleaseBuffer(it->second);
+                it = threadBuffers.Buffers.erase(it);
+            }
+            else
+                ++it;
+
+        threadBuffers.SweepSize = std::max(MinThreadBuffersSweepSize, threadBuffers.Buffers.size() * 2);
+    }
+
+    Registry& GetRegistry()
+    {
+        Registry* registry = Data.load(std::memory_order_acquire);
+        if (registry != nullptr)
+            return *registry;
+
+        Registry* newRegistry = new Registry;
+        if (Data.compare_exchange_strong(registry, newRegistry, std::memory_order_acq_rel, std::memory_order_acquire))
+            return *newRegistry;
+
+        delete newRegistry;
+        return *registry;
+    }
+
+    Buffer& GetThreadBuffer(Registry& registry)
+    {
+        ThreadBuffers& threadBuffers = GetLocalThreadBuffers();
+        if (threadBuffers.LastRegistry == &registry && !IsOrphaned(threadBuffers.LastBuffer))
+            return *threadBuffers.LastBuffer;
+
+        // Buffer of the destroyed lock at the same address is replaced
+        Buffer*& buffer = threadBuffers.Buffers[&registry];
+        if (buffer != nullptr && IsOrphaned(buffer))
+        {
+            ReleaseBuffer(buffer);
+            buffer = nullptr;
+        }
+
+        Buffer* threadBuffer = buffer;
+        if (threadBuffer == nullptr)
+        {
+            threadBuffer = new Buffer;
+            buffer = threadBuffer;
+
+            Buffer* head = registry.Buffers.load(std::memory_order_relaxed);
+            do
+                threadBuffer->Next = head;
+            while (!registry.Buffers.compare_exchange_weak(head, threadBuffer, std::memory_order_release, std::memory_order_relaxed));
+
+            if (threadBuffers.Buffers.size() > threadBuffers.SweepSize)
+                SweepThreadBuffers(threadBuffers);
+        }
+
+        threadBuffers.LastRegistry = &registry;
+        threadBuffers.LastBuffer = threadBuffer;
+        return *threadBuffer;
+    }
+
+    Buffer& GetThreadBuffer()
+    {
+        return GetThreadBuffer(GetRegistry());
+    }
+
+    static void AddToHistogram(std::atomic<std::uint64_t>* histogram, std::uint64_t time)
+    {
+        std::size_t bucket = 0;
+        while (time != 0 && bucket < LockStatisticsSnapshot::HistogramBucketsAmount - 1)
+        {
+            time >>= 1;
+            ++bucket;
+        }
+
+        histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void SumHistogram(const std::atomic<std::uint64_t>* histogram, LockStatisticsSnapshot::Histogram& result)
+    {
+        for (std::size_t i = 0; i < LockStatisticsSnapshot::HistogramBucketsAmount; ++i)
+            result[i] += histogram[i].load(std::memory_order_relaxed);
+    }
+
+    void UpdateMaxReaders(std::uint64_t readers)
+    {
+        std::atomic<std::uint64_t>& maxReaders = GetRegistry().MaxReaders;
+        std::uint64_t currentMaxReaders = maxReaders.load(std::memory_order_relaxed);
+        while (readers > currentMaxReaders && !maxReaders.compare_exchange_weak(currentMaxReaders, readers, std::memory_order_relaxed));
+    }
+
+    // Starts the hold time measurement of every ReadHoldSamplingPeriod-th read lock of the thread
+    void SampleReadHold()
+    {
+        HeldReadLocks& heldReadLocks = GetLocalThreadHeldReadLocks();
+        if (++heldReadLocks.SamplingCounter % ReadHoldSamplingPeriod == 0 && heldReadLocks.Size < HeldReadLocksAmount)
+            heldReadLocks.Locks[heldReadLocks.Size++] = { this, Now() };
+    }
+
+public:
+    /// \brief Statistics are enabled
+    static constexpr bool IsEnabled = true;
+
+    /// \brief Only every ReadHoldSamplingPeriod-th read lock of a thread measures the hold time
+    static constexpr unsigned ReadHoldSamplingPeriod = 16;
+
+    /// \brief Write locks that waited longer than this amount of nanoseconds are counted as writer starvation
+    static constexpr std::uint64_t WriterStarvationThreshold = LOCK_STATISTICS_WRITER_STARVATION_NS;
+
+    /// \brief Default constructor. Nothing is allocated until the first event
+    LockStatistics() {}
+
+    LockStatistics(const LockStatistics&) = delete;
+    LockStatistics& operator=(const LockStatistics&) = delete;
+
+    /// \brief Destructor. Releases the buffers. Threads remove their part of the buffers later
+    ~LockStatistics()
+    {
+        delete Data.load(std::memory_order_acquire);
+    }
+
+    /// \brief Method for getting the current time for the wait measurements
+    /// \return time in nanoseconds
+    static std::uint64_t Now()
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    /// \brief Method to record the read lock without waiting
+    /// \param [in] readers amount of readers after the lock, zero if unknown
+    void OnReadAcquire(std::uint64_t readers)
+    {
+        GetThreadBuffer().ReadAcquisitions.fetch_add(1, std::memory_order_relaxed);
+        UpdateMaxReaders(readers);
+        SampleReadHold();
+    }
+
+    /// \brief Method to record the read lock that had to wait
+    /// \param [in] waitStart time from Now when the wait started
+    /// \param [in] readers amount of readers after the lock, zero if unknown
+    void OnContendedReadAcquire(std::uint64_t waitStart, std::uint64_t readers)
+    {
+        Buffer& buffer = GetThreadBuffer();
+        buffer.ReadAcquisitions.fetch_add(1, std::memory_order_relaxed);
+        buffer.ContendedReadAcquisitions.fetch_add(1, std::memory_order_relaxed);
+        AddToHistogram(buffer.ReadWaitHistogram, Now() - waitStart);
+        UpdateMaxReaders(readers);
+        SampleReadHold();
+    }
+
+    /// \brief Method to record the read unlock
+    void OnReadRelease()
+    {
+        HeldReadLocks& heldReadLocks = GetLocalThreadHeldReadLocks();
+        for (std::size_t i = heldReadLocks.Size; i > 0; --i)
+            if (heldReadLocks.Locks[i - 1].Statistics == this)
+            {
+                AddToHistogram(GetThreadBuffer().ReadHoldHistogram, Now() - heldReadLocks.Locks[i - 1].AcquireTime);
+                heldReadLocks.Locks[i - 1] = heldReadLocks.Locks[--heldReadLocks.Size];
+                return;
+            }
+    }
+
+    /// \brief Method to record the write lock
+    /// \param [in] waitStart time from Now when the write lock was called
+    /// \param [in] isContended true if the writer had to wait for another writer or for readers
+    void OnWriteAcquire(std::uint64_t waitStart, bool isContended)
+    {
+        Registry& registry = GetRegistry();
+        Buffer& buffer = GetThreadBuffer(registry);
+        registry.WriteAcquireTime = Now();
+        std::uint64_t waitTime = registry.WriteAcquireTime - waitStart;
+
+        buffer.WriteAcquisitions.fetch_add(1, std::memory_order_relaxed);
+        if (isContended)
+            buffer.ContendedWriteAcquisitions.fetch_add(1, std::memory_order_relaxed);
+        if (waitTime > WriterStarvationThreshold)
+            buffer.WriterStarvationEvents.fetch_add(1, std::memory_order_relaxed);
+
+        AddToHistogram(buffer.WriteWaitHistogram, waitTime);
+    }
+
+    /// \brief Method to record the write unlock
+    void OnWriteRelease()
+    {
+        Registry& registry = GetRegistry();
+        AddToHistogram(GetThreadBuffer(registry).WriteHoldHistogram, Now() - registry.WriteAcquireTime);
+    }
+
+    /// \brief Method for getting the sum of the buffers of all threads
+    /// \return statistics snapshot
+    LockStatisticsSnapshot GetSnapshot() const
+    {
+        LockStatisticsSnapshot snapshot;
+
+        const Registry* registry = Data.load(std::memory_order_acquire);
+        if (registry == nullptr)
+            return snapshot;
+
+        for (const Buffer* it = registry->Buffers.load(std::memory_order_acquire); it != nullptr; it = it->Next)
+        {
+            const Buffer& buffer = *it;
+            snapshot.ReadAcquisitions += buffer.ReadAcquisitions.load(std::memory_order_relaxed);
+            snapshot.WriteAcquisitions += buffer.WriteAcquisitions.load(std::memory_order_relaxed);
+            snapshot.ContendedReadAcquisitions += buffer.ContendedReadAcquisitions.load(std::memory_order_relaxed);
+            snapshot.ContendedWriteAcquisitions += buffer.ContendedWriteAcquisitions.load(std::memory_order_relaxed);
+            snapshot.WriterStarvationEvents += buffer.WriterStarvationEvents.load(std::memory_order_relaxed);
+
+            SumHistogram(buffer.ReadWaitHistogram, snapshot.ReadWaitHistogram);
+            SumHistogram(buffer.WriteWaitHistogram, snapshot.WriteWaitHistogram);
+            SumHistogram(buffer.ReadHoldHistogram, snapshot.ReadHoldHistogram);
+            SumHistogram(buffer.WriteHoldHistogram, snapshot.WriteHoldHistogram);
+        }
+
+        snapshot.MaxReaders = registry->MaxReaders.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+};
+
+#else
+
+/**
+    \brief Lock statistics collector
+
+    Statistics are disabled, so all methods do nothing and the compiler removes them.
+    Define LOCK_STATISTICS to enable them.
+*/
+class LockStatistics
+{
+public:
+    static constexpr bool IsEnabled = false;
+
+    static std::uint64_t Now() { return 0; }
+    void OnReadAcquire(std::uint64_t) {}
+    void OnContendedReadAcquire(std::uint64_t, std::uint64_t) {}
+    void OnReadRelease() {}
+    void OnWriteAcquire(std::uint64_t, bool) {}
+    void OnWriteRelease() {}
+    LockStatisticsSnapshot GetSnapshot() const { return LockStatisticsSnapshot(); }
+};
+
+#endif
@@ -4,210 +4,12 @@
 #include <atomic>
 #include <condition_variable>
 
-
-/**
-    \brief A class for synchronizing threads
-
-    A class for thread management that allows you to lock sections of code for reading or writing.
-    A write lock will ensure that there can only be one thread in the code section at a time.
-    The read lock will ensure that no thread using the write lock gets into the code section until all threads using the read lock are unblocked.
-    At the same time, after the write lock, no new threads with a read lock will enter the code section until all threads using the write lock are unblocked.
- */
-class ReadWriteMutex
-{
-private:
-    std::mutex WriteMutex, ReadMutex;
-    std::atomic_int ReadCounter;
-    std::atomic_bool IsCondVarWaiting;
-    std::condition_variable Cv;
-public:
-    /// \brief Default constructor
-    ReadWriteMutex() 
-    { 
-        ReadCounter.store(0);
-        IsCondVarWaiting.store(false);
-    }
-
-    /**
-        \brief A method for locking a section of code for reading
-
-        Using this method, you can lock the code section for reading, which means that all threads using the read lock will have access to data inside the code section
-        but threads using the write lock will wait until all read operations are completed.
-    */
-    void ReadLock()
-    {
-        WriteMutex.lock();
-        ReadMutex.lock();
-        ReadCounter.fetch_add(1);
-        ReadMutex.unlock();
-        WriteMutex.unlock();
-    }
-
-    /// \brief A method for unlocking a section of code for reading
-    void ReadUnlock()
-    {
-        ReadMutex.lock();
-        ReadCounter.fetch_sub(1);
-
-        if (ReadCounter.load() == 0)
-            while (IsCondVarWaiting.load()) Cv.notify_all();
-        
-        ReadMutex.unlock();
-    }
-
-    /**
-        \brief A method for locking a section of code for writing
-
-        This method provides exclusive access to a section of code for a single thread.
-        All write operations will be performed sequentially.
-        This method takes precedence over the read lock, which means that after calling this method, no new read operations will be started.
-    */
-    void WriteLock()
-    {
-        std::mutex mtx;
-        std::unique_lock<std::mutex> lk(mtx);
-
-        WriteMutex.lock();
-        
-        IsCondVarWaiting.store(true);
-
-        if (ReadCounter.load() > 0) Cv.wait(lk);
-        
-        IsCondVarWaiting.store(false);
-    }
-
-    /// \brief A method for unlocking a section of code for writing
-    void WriteUnlock()
-    {
-        WriteMutex.unlock();
-    }
-};
-
-thread_local std::size_t LocalThreadReadLockCounter = 0;
-thread_local std::size_t LocalThreadWriteLockCounter = 0;
-
-/**
-    \brief A class for synchronizing threads
-
-    A class for thread management that allows you to lock sections of code for reading or writing.
-    A write lock will ensure that there can only be one thread in the code section at a time.
-    The read lock will ensure that no thread using the write lock gets into the code section until all threads using the read lock are unblocked.
-    At the same time, after the write lock, no new threads with a read lock will enter the code section until all threads using the write lock are unblocked.
-    Recursiveness allows you to call blocking methods in the same thread multiple times without self-locking.
-*/
-class RecursiveReadWriteMutex
-{
-private:
-    ReadWriteMutex Rwmx;
-
-public:
-    
-    /**
-        \brief A method for locking a section of code for reading
-
-        Using this method, you can lock the code section for reading, which means that all threads using the read lock will have access to data inside the code section
-        but threads using the write lock will wait until all read operations are completed.
-        Note that, in fact, blocking for reading inside writing does not make sense, 
-        since the code section is already locked and therefore nothing will happen inside the function in such a situation.
-    */
-    void ReadLock()
-    {
-        if (LocalThreadWriteLockCounter == 0)
-        {
-            if (LocalThreadReadLockCounter == 0)
-                Rwmx.ReadLock();
-
-            ++LocalThreadReadLockCounter;
-        }
-    }
-
-    /// \brief A method for unlocking a section of code for reading
-    void ReadUnlock()
-    {
-        if (LocalThreadWriteLockCounter == 0)
-        {
-            if (LocalThreadReadLockCounter == 1)
-                Rwmx.ReadUnlock();
-            
-            --LocalThreadReadLockCounter;
-        }
-    }
-
-    /**
-        \brief A method for locking a section of code for writing
-
-        This method provides exclusive access to a section of code for a single thread.
-        All write operations will be performed sequentially.
-        This method takes precedence over the read lock, which means that after calling this method, no new read operations will be started.
-        Note that if the write lock is called inside the read lock, then this will be equivalent to unlocking for reading and then locking for writing.
-    */
-    void WriteLock()
-    {
-        if (LocalThreadWriteLockCounter == 0)
-        {
-            if (LocalThreadReadLockCounter > 0)
-                Rwmx.ReadUnlock();
-            
-            Rwmx.WriteLock();
-        }
-
-        ++LocalThreadWriteLockCounter;
-    }
-
-    /// \brief A method for unlocking a section of code for writing
-    /// Note that if the write unlock is called inside the read lock, then this will be equivalent to unlocking for writing and then locking for reading.
-    void WriteUnlock()
-    {
-        if (LocalThreadWriteLockCounter == 1)
-        {
-            Rwmx.WriteUnlock();
-            if (LocalThreadReadLockCounter > 0)
-                Rwmx.ReadLock();
-        }
-        --LocalThreadWriteLockCounter;
-    }
-};
-
-template <class Lock>
-class ReadLock
-{
-private:
-    Lock& Mtx;
-
-public:
-    ReadLock(Lock& mtx) : Mtx(mtx)
-    {
-        Mtx.ReadLock();
-    }
-
-    ~ReadLock()
-    {
-        Mtx.ReadUnlock();
-    }
-};
-
-template <class Lock>
-class WriteLock
-{
-private:
-    Lock& Mtx;
-
-public:
-    WriteLock(Lock& mtx) : Mtx(mtx)
-    {
-        Mtx.WriteLock();
-    }
-
-    ~WriteLock()
-    {
-        Mtx.WriteUnLock();
-    }
-};
+#include "ReadWriteMutex.h"
 
 // Demo
 #include <vector>
 
-RecursiveReadWriteMutex Rrwmx;
+RecursiveReadWriteMutex<> Rrwmx;
 std::vector<int> Vec;
 std::condition_variable Cv;
 auto const timeout = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
@@ -275,7 +77,7 @@ int main()
     else
         std::cout << "Ok" << std::endl;
 
-    RecursiveReadWriteMutex rrwx;
+    RecursiveReadWriteMutex<> rrwx;
     rrwx.ReadLock();
     rrwx.ReadLock();
     rrwx.ReadUnlock();
@@ -333,6 +135,73 @@ int main()
     th5.join();
 
 
-    ReadLock<RecursiveReadWriteMutex> rlk(rrwx);
-    ReadLock<RecursiveReadWriteMutex> wlk(rrwx);
+    ReadLock<RecursiveReadWriteMutex<>> rlk(rrwx);
+    WriteLock<RecursiveReadWriteMutex<>> wlk(rrwx);
+
+    // Lookup, insert if missing
+    ReadWriteMutex<> rwmx;
+    rwmx.UpgradableReadLock();
+    if (Vec.empty())
+    {
+        rwmx.UpgradeToWriteLock();
+        Vec.emplace_back(0);
+        rwmx.DowngradeToReadLock();
+        std::cout << "Inserted: " << Vec.front() << std::endl;
+        rwmx.ReadUnlock();
+    }
+    else
+        rwmx.UpgradableReadUnlock();
+
+    ShardedReadWriteMutex srwmx;
+    ReadLock<ShardedReadWriteMutex> srlk(srwmx);
+
+    // Lock two objects of the table at once
+    StripedReadWriteMutex<1024> stripes;
+    int first = 0, second = 0;
+    stripes.WriteLock(&first, &second);
+    ++first;
+    ++second;
+    stripes.WriteUnlock(&first, &second);
+    ReadLock<ReadWriteMutex<>> stlk(stripes.GetStripe(&first));
+
+    CompactReadWriteMutex crwmx;
+    ReadLock<CompactReadWriteMutex> crlk(crwmx);
+
+    NumaReadWriteMutex<> nrwmx;
+    ReadLock<NumaReadWriteMutex<>> nrlk(nrwmx);
+
+    // Guard released earlier and guards of several mutexes without deadlock
+    ReadWriteMutex<> firstRwmx, secondRwmx;
+    WriteLock<ReadWriteMutex<>> flk(firstRwmx, std::try_to_lock);
+    if (flk)
+        flk.Unlock();
+    ScopedWriteLock<ReadWriteMutex<>, ReadWriteMutex<>> bothlk(firstRwmx, secondRwmx);
+
+    // Latency critical writer goes before the waiting writers with the default priority
+    PriorityReadWriteMutex prwmx;
+    prwmx.WriteLock(10);
+    prwmx.WriteUnlock();
+    prwmx.ReadLock(10);
+    prwmx.ReadUnlock();
+
+    // Object with the lock inside instead of the lock and the object side by side
+    SharedGuarded<std::vector<int>> guardedVec;
+    guardedVec.Write([](std::vector<int>& vec) { vec.emplace_back(1); });
+    std::cout << guardedVec.Read([](const std::vector<int>& vec) { return vec.size(); }) << std::endl;
+
+    // Reader holds the lock for the whole batch and lets the writer in only between the items
+    ReadWriteMutex<> batchRwmx;
+    std::vector<int> batch(1000, 1);
+    int batchSum = 0;
+    std::thread batchWriter([&]() { batchRwmx.WriteLock(); batch[0] = 2; batchRwmx.WriteUnlock(); });
+    {
+        ReadSession<ReadWriteMutex<>> session(batchRwmx);
+        for (std::size_t i = 0; i < batch.size(); ++i)
+        {
+            batchSum += batch[i];
+            session.Checkpoint();
+        }
+        std::cout << "Batch sum " << batchSum << ", writers let in " << session.GetYieldsAmount() << std::endl;
+    }
+    batchWriter.join();
 }
\ No newline at end of file
@@ -0,0 +1,2609 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <shared_mutex>
+#include <tuple>
+#include <limits>
+
+#if defined __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#include "LockCommon.h"
+
+/**
+    \brief A class for synchronizing threads
+
+    A class for thread management that allows you to lock sections of code for reading or writing.
+    A write lock will ensure that there can only be one thread in the code section at a time.
+    The read lock will ensure that no thread using the write lock gets into the code section until all threads using the read lock are unblocked.
+    Which threads get the code section first when readers and writers compete is set by the fairness policy:
+    WriterPreferringPolicy, ReaderPreferringPolicy or PhaseFairPolicy from LockCommon.h.
+    The policy is resolved at compile time, so the read lock without writers always costs one atomic operation.
+
+    \tparam FairnessPolicy fairness policy. By default writers take precedence over the readers
+*/
+template <class FairnessPolicy = WriterPreferringPolicy>
+class ReadWriteMutex : public SharedTimedMutexInterface<ReadWriteMutex<FairnessPolicy>>
+{
+private:
+    static_assert(IsFairnessPolicy<FairnessPolicy>, "ReadWriteMutex: unknown fairness policy");
+
+    static constexpr bool IsWriterPreferring = std::is_same<FairnessPolicy, WriterPreferringPolicy>::value;
+    static constexpr bool IsPhaseFair = std::is_same<FairnessPolicy, PhaseFairPolicy>::value;
+
+    // Lowest 32 bits of the state word store the amount of threads inside the read lock.
+    // Next 31 bits store the amount of writers waiting for the code section. Every blocked writer is counted there,
+    // so the counters are wide enough for any amount of threads and can not overflow into the neighbouring fields.
+    // The highest bit is set when a writer is inside the write lock.
+    static constexpr std::uint64_t ReaderMask = 0x00000000FFFFFFFFull;
+    static constexpr std::uint64_t WaitingWriter = 0x0000000100000000ull;
+    static constexpr std::uint64_t WaitingWriterMask = 0x7FFFFFFF00000000ull;
+    static constexpr std::uint64_t WriterBit = 0x8000000000000000ull;
+
+    // Packed state word: reader counter, waiting writers counter and writer bit.
+    // Every reader writes it, so it has its own cache line and the writer fields are not invalidated by the readers
+    alignas(CacheLineSize) std::atomic<std::uint64_t> State;
+
+    // Version for the optimistic reads. Odd while a writer is inside the write lock. Changed only by the writer.
+    // Optimistic readers only read it, so it is not placed on the cache line of the state word
+    alignas(CacheLineSize) std::atomic<unsigned> Version;
+
+    // Statistics collector. Empty if LOCK_STATISTICS is not defined, otherwise a pointer that is only read after the first event,
+    // so it shares the read-mostly cache line of the version
+    [[no_unique_address]] LockStatistics Statistics;
+
+    // Incremented each time when readers are let in after a write. Stopped readers wait on it.
+    // This and the next fields are used only by the writers and by the stopped readers
+    alignas(CacheLineSize) std::atomic<unsigned> ReadPhase;
+
+    // Amount of readers stopped by a writer. Used only by the phase-fair policy
+    std::atomic<unsigned> StoppedReaders;
+
+    // Mutex to serialize writers
+    std::timed_mutex WriteMutex;
+
+    // Spin-then-park strategies for stopped readers and for the writer waiting for readers
+    AdaptiveWaiter ReaderWaiter, WriterWaiter;
+
+    // Amount of optimistic read attempts before the read lock is taken
+    static constexpr unsigned OptimisticReadAttempts = 16;
+
+    // Checks if new readers have to wait with such state word
+    static constexpr bool IsReaderStopped(std::uint64_t state)
+    {
+        if constexpr (std::is_same<FairnessPolicy, ReaderPreferringPolicy>::value)
+            return (state & WriterBit) != 0;
+        else
+            return (state & (WriterBit | WaitingWriterMask)) != 0;
+    }
+
+    // Slow path of the read lock. Called only when a writer stops the readers
+    void ReadLockSlow()
+    {
+        std::uint64_t waitStart = Statistics.Now();
+        bool isCounted = false;
+
+        for (;;)
+        {
+            std::uint64_t state = State.load(std::memory_order_relaxed);
+            if (!IsReaderStopped(state))
+            {
+                if (State.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    Statistics.OnContendedReadAcquire(waitStart, (state + 1) & ReaderMask);
+                    break;
+                }
+                continue;
+            }
+
+            // Register as a stopped reader, so the next writer let this reader in first
+            if constexpr (IsPhaseFair)
+                if (!isCounted)
+                {
+                    StoppedReaders.fetch_add(1, std::memory_order_seq_cst);
+                    isCounted = true;
+                    continue;
+                }
+
+            ReaderWaiter.Wait([this]() { return !IsReaderStopped(State.load(std::memory_order_seq_cst)); },
+                [this]()
+                {
+                    // Phase is changed after the state word, so if the writer is still here, then wait can not miss the phase change
+                    unsigned phase = ReadPhase.load(std::memory_order_acquire);
+                    if (IsReaderStopped(State.load(std::memory_order_seq_cst)))
+                        ReadPhase.wait(phase, std::memory_order_acquire);
+                });
+        }
+
+        if constexpr (IsPhaseFair)
+            if (isCounted && StoppedReaders.fetch_sub(1, std::memory_order_release) == 1)
+                StoppedReaders.notify_one();
+    }
+
+    // Tries to set the writer bit if there are no readers. Called only by the writer owning WriteMutex
+    bool TrySetWriterBit()
+    {
+        std::uint64_t state = State.load(std::memory_order_acquire);
+        while ((state & ReaderMask) == 0)
+            if (State.compare_exchange_weak(state, state | WriterBit, std::memory_order_acquire, std::memory_order_acquire))
+                return true;
+
+        return false;
+    }
+
+    // Waits until the readers stopped by the previous writer enter the code section. Used only by the phase-fair policy
+    void WaitForStoppedReaders()
+    {
+        WriterWaiter.Wait([this]() { return StoppedReaders.load(std::memory_order_seq_cst) == 0; },
+            [this]()
+            {
+                unsigned stoppedReaders = StoppedReaders.load(std::memory_order_seq_cst);
+                if (stoppedReaders != 0)
+                    StoppedReaders.wait(stoppedReaders, std::memory_order_acquire);
+            });
+    }
+
+    // Locks WriteMutex. Returns true if the mutex was held by another thread. It is checked only if statistics are enabled
+    bool LockWriteMutex()
+    {
+        if constexpr (LockStatistics::IsEnabled)
+            if (WriteMutex.try_lock())
+                return false;
+
+        WriteMutex.lock();
+        return true;
+    }
+
+    // Waits until all readers leave the code section and sets the writer bit. Called only by the writer owning WriteMutex.
+    // Returns true if the writer had to wait
+    bool WaitForWriterBit()
+    {
+        if (TrySetWriterBit())
+            return false;
+
+        do
+            WriterWaiter.Wait([this]() { return (State.load(std::memory_order_acquire) & ReaderMask) == 0; },
+                [this]()
+                {
+                    // Wait compares the state word atomically, so the wakeup from the last reader cannot be lost
+                    std::uint64_t state = State.load(std::memory_order_acquire);
+                    if ((state & ReaderMask) != 0)
+                        State.wait(state, std::memory_order_acquire);
+                });
+        while (!TrySetWriterBit());
+
+        return true;
+    }
+
+    // Lets in the readers stopped by the writers
+    void WakeStoppedReaders()
+    {
+        ReadPhase.fetch_add(1, std::memory_order_release);
+        ReadPhase.notify_all();
+    }
+
+    // Makes the version odd. Called by the writer right after it gets the code section
+    void BeginWriteVersion()
+    {
+        Version.store(Version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        // Writes of the code section must not become visible before the odd version
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    // Makes the version even. Called by the writer right before it leaves the code section
+    void EndWriteVersion()
+    {
+        Version.store(Version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Removes the writer from the waiting writers counter. Called when the timed write lock gives up
+    void CancelWaitingWriter()
+    {
+        std::uint64_t state = State.fetch_sub(WaitingWriter, std::memory_order_release) - WaitingWriter;
+        if (!IsReaderStopped(state))
+            WakeStoppedReaders();
+    }
+
+public:
+    /// \brief Default constructor
+    ReadWriteMutex() 
+    { 
+        State.store(0);
+        ReadPhase.store(0);
+        StoppedReaders.store(0);
+        Version.store(0);
+    }
+
+    /// \brief Destructor. Removes the mutex from the lock order graph if LOCK_ORDER_CHECKING is defined
+    ~ReadWriteMutex()
+    {
+        LockOrderChecker::OnDestroy(this);
+    }
+
+    /// \brief Method for setting the upper bound for spinning before the thread is parked
+    /// \param [in] maxSpinLimit maximum amount of CpuRelax calls before parking. Zero means to park at once
+    void SetMaxSpinLimit(unsigned maxSpinLimit)
+    {
+        ReaderWaiter.SetMaxSpinLimit(maxSpinLimit);
+        WriterWaiter.SetMaxSpinLimit(maxSpinLimit);
+    }
+
+    /// \brief Method for getting the lock statistics
+    /// \return statistics snapshot. All zeros if LOCK_STATISTICS is not defined
+    LockStatisticsSnapshot GetStatistics() const
+    {
+        return Statistics.GetSnapshot();
+    }
+
+    /**
+        \brief A method for locking a section of code for reading
+
+        Using this method, you can lock the code section for reading, which means that all threads using the read lock will have access to data inside the code section
+        but threads using the write lock will wait until all read operations are completed.
+        If there is no writer, then the lock costs one atomic operation on the state word.
+    */
+    void ReadLock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        LockOrderChecker::OnAcquire(this, false, false, LOCK_ORDER_SITE);
+
+        std::uint64_t state = State.load(std::memory_order_relaxed);
+        if (!IsReaderStopped(state) && State.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            Statistics.OnReadAcquire((state + 1) & ReaderMask);
+            return;
+        }
+
+        ReadLockSlow();
+    }
+
+    /// \brief A method for trying to lock a section of code for reading without waiting
+    /// \return true if locked, false if a writer stops the readers
+    bool TryReadLock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        std::uint64_t state = State.load(std::memory_order_relaxed);
+        while (!IsReaderStopped(state))
+            if (State.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                Statistics.OnReadAcquire((state + 1) & ReaderMask);
+                LockOrderChecker::OnTryAcquire(this, false, LOCK_ORDER_SITE);
+                return true;
+            }
+
+        return false;
+    }
+
+    /// \brief A method for trying to lock a section of code for reading until the time point
+    /// \param [in] timePoint time point to wait until
+    /// \return true if locked, false if the time point is reached
+    template <class Clock, class Duration>
+    bool TryReadLockUntil(const std::chrono::time_point<Clock, Duration>& timePoint LOCK_ORDER_SITE_NEXT_PARAMETER)
+    {
+        return WaitUntil(timePoint, [&]() { return TryReadLock(LOCK_ORDER_SITE_ARGUMENT); });
+    }
+
+    /// \brief A method for checking if a writer waits for the code section or is inside it. It costs one load
+    /// \return true if a writer waits, so the readers holding the lock for a long time should let it in, for example with ReadSession
+    bool IsWriterWaiting() const
+    {
+        return (State.load(std::memory_order_relaxed) & (WaitingWriterMask | WriterBit)) != 0;
+    }
+
+    /// \brief A method for unlocking a section of code for reading
+    void ReadUnlock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        LockOrderChecker::OnRelease(this, false, LOCK_ORDER_SITE);
+        Statistics.OnReadRelease();
+
+        std::uint64_t prev = State.fetch_sub(1, std::memory_order_release);
+
+        // Last reader wakes up the waiting writer. Only the writer owning WriteMutex waits on the state word
+        if ((prev & ReaderMask) == 1 && (prev & WaitingWriterMask) != 0)
+            State.notify_one();
+    }
+
+    /**
+        \brief A method for reading without the read lock
+
+        Reads the version, calls the function and checks that the version did not change, so no writer was inside the code section.
+        If a writer intervened, then the function is called again. After several failed attempts the function is called inside the read lock.
+        Optimistic readers do not write to the shared memory, so they do not slow down each other.
+        The function can be called several times and can see data that is being changed by the writer, so it must only copy the data
+        into local variables and must not follow pointers or make decisions based on it. Shared data should be read with relaxed atomics,
+        otherwise it is a data race for the C++ memory model. The copied data can be used after this method returns.
+
+        \param [in] function function that copies the shared data
+    */
+    template <class Function>
+    void OptimisticRead(Function function LOCK_ORDER_SITE_NEXT_PARAMETER)
+    {
+        for (unsigned i = 0; i < OptimisticReadAttempts; ++i)
+        {
+            unsigned version = Version.load(std::memory_order_acquire);
+            if ((version & 1) == 0)
+            {
+                function();
+
+                // Reads of the function must not be moved after the version check
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (Version.load(std::memory_order_relaxed) == version)
+                    return;
+            }
+
+            CpuRelax();
+        }
+
+        ReadLock(LOCK_ORDER_SITE_ARGUMENT);
+        function();
+        ReadUnlock(LOCK_ORDER_SITE_ARGUMENT);
+    }
+
+    /**
+        \brief A method for locking a section of code for writing
+
+        This method provides exclusive access to a section of code for a single thread.
+        All write operations will be performed sequentially.
+        With the writer-preferring and phase-fair policies, after calling this method, no new read operations will be started.
+        With the reader-preferring policy new read operations will be started until there are no readers at all.
+    */
+    void WriteLock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        LockOrderChecker::OnAcquire(this, true, false, LOCK_ORDER_SITE);
+        std::uint64_t waitStart = Statistics.Now();
+
+        // Writer-preferring policy stops readers before the writer gets WriteMutex, so writers that wait for each other keep readers stopped
+        if constexpr (IsWriterPreferring)
+            State.fetch_add(WaitingWriter, std::memory_order_relaxed);
+
+        bool isContended = LockWriteMutex();
+
+        if constexpr (!IsWriterPreferring)
+        {
+            // Let in the readers stopped by the previous writer
+            if constexpr (IsPhaseFair)
+                WaitForStoppedReaders();
+
+            State.fetch_add(WaitingWriter, std::memory_order_seq_cst);
+        }
+
+        isContended = WaitForWriterBit() || isContended;
+        Statistics.OnWriteAcquire(waitStart, isContended);
+        BeginWriteVersion();
+    }
+
+    /// \brief A method for trying to lock a section of code for writing without waiting
+    /// \return true if locked, false if there is another writer or there are readers in the code section
+    bool TryWriteLock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        if (!WriteMutex.try_lock())
+            return false;
+
+        if constexpr (IsPhaseFair)
+            if (StoppedReaders.load(std::memory_order_seq_cst) != 0)
+            {
+                WriteMutex.unlock();
+                return false;
+            }
+
+        std::uint64_t state = State.load(std::memory_order_relaxed);
+        while ((state & ReaderMask) == 0)
+            if (State.compare_exchange_weak(state, state + (WaitingWriter | WriterBit), std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                Statistics.OnWriteAcquire(Statistics.Now(), false);
+                BeginWriteVersion();
+                LockOrderChecker::OnTryAcquire(this, true, LOCK_ORDER_SITE);
+                return true;
+            }
+
+        WriteMutex.unlock();
+        return false;
+    }
+
+    /**
+        \brief A method for trying to lock a section of code for writing until the time point
+
+        While waiting, the method stops new readers the same way as WriteLock.
+        If the time point is reached, the stopped readers are let in again.
+
+        \param [in] timePoint time point to wait until
+        \return true if locked, false if the time point is reached
+    */
+    template <class Clock, class Duration>
+    bool TryWriteLockUntil(const std::chrono::time_point<Clock, Duration>& timePoint LOCK_ORDER_SITE_NEXT_PARAMETER)
+    {
+        if (TryWriteLock(LOCK_ORDER_SITE_ARGUMENT))
+            return true;
+
+        std::uint64_t waitStart = Statistics.Now();
+
+        if constexpr (IsWriterPreferring)
+            State.fetch_add(WaitingWriter, std::memory_order_relaxed);
+
+        if (!WriteMutex.try_lock_until(timePoint))
+        {
+            if constexpr (IsWriterPreferring)
+                CancelWaitingWriter();
+            return false;
+        }
+
+        if constexpr (!IsWriterPreferring)
+        {
+            if constexpr (IsPhaseFair)
+                if (!WaitUntil(timePoint, [this]() { return StoppedReaders.load(std::memory_order_seq_cst) == 0; }))
+                {
+                    WriteMutex.unlock();
+                    return false;
+                }
+
+            State.fetch_add(WaitingWriter, std::memory_order_seq_cst);
+        }
+
+        if (WaitUntil(timePoint, [this]() { return TrySetWriterBit(); }))
+        {
+            Statistics.OnWriteAcquire(waitStart, true);
+            BeginWriteVersion();
+            LockOrderChecker::OnTryAcquire(this, true, LOCK_ORDER_SITE);
+            return true;
+        }
+
+        CancelWaitingWriter();
+        WriteMutex.unlock();
+        return false;
+    }
+
+    /// \brief A method for unlocking a section of code for writing
+    void WriteUnlock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        LockOrderChecker::OnRelease(this, true, LOCK_ORDER_SITE);
+        EndWriteVersion();
+        Statistics.OnWriteRelease();
+
+        std::uint64_t state = State.fetch_sub(WriterBit | WaitingWriter, std::memory_order_release) - (WriterBit | WaitingWriter);
+        WriteMutex.unlock();
+
+        // Let in the stopped readers if there is no other writer to stop them
+        if (!IsReaderStopped(state))
+            WakeStoppedReaders();
+    }
+
+    /**
+        \brief A method for locking a section of code for upgradable reading
+
+        The upgradable read lock works together with the usual read locks, but there can be only one upgradable reader at a time
+        and there can be no writers while it is held. So the upgradable reader can upgrade to the write lock without letting another writer in.
+        It is useful for "lookup, insert if missing" code sections.
+        Must be unlocked with UpgradableReadUnlock or upgraded with UpgradeToWriteLock.
+    */
+    void UpgradableReadLock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        LockOrderChecker::OnAcquire(this, false, false, LOCK_ORDER_SITE);
+
+        // WriteMutex keeps out writers and other upgradable readers, so there is no active writer here
+        WriteMutex.lock();
+        Statistics.OnReadAcquire((State.fetch_add(1, std::memory_order_acquire) + 1) & ReaderMask);
+    }
+
+    /// \brief A method for trying to lock a section of code for upgradable reading without waiting
+    /// \return true if locked, false if there is a writer or another upgradable reader
+    bool TryUpgradableReadLock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        if (!WriteMutex.try_lock())
+            return false;
+
+        Statistics.OnReadAcquire((State.fetch_add(1, std::memory_order_acquire) + 1) & ReaderMask);
+        LockOrderChecker::OnTryAcquire(this, false, LOCK_ORDER_SITE);
+        return true;
+    }
+
+    /// \brief A method for unlocking a section of code for upgradable reading
+    void UpgradableReadUnlock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        LockOrderChecker::OnRelease(this, false, LOCK_ORDER_SITE);
+        Statistics.OnReadRelease();
+        State.fetch_sub(1, std::memory_order_release);
+        WriteMutex.unlock();
+    }
+
+    /**
+        \brief A method for upgrading the upgradable read lock to the write lock
+
+        The thread does not leave the code section during the upgrade, so no writer can change data between the read and the write.
+        The method waits until all usual readers leave the code section.
+        After that the lock must be unlocked with WriteUnlock or downgraded.
+    */
+    void UpgradeToWriteLock()
+    {
+        LockOrderChecker::OnConvert(this, true);
+        Statistics.OnReadRelease();
+        std::uint64_t waitStart = Statistics.Now();
+
+        // One step from the reader to the waiting writer
+        State.fetch_add(WaitingWriter - 1, std::memory_order_seq_cst);
+
+        Statistics.OnWriteAcquire(waitStart, WaitForWriterBit());
+        BeginWriteVersion();
+    }
+
+    /// \brief A method for trying to upgrade the upgradable read lock to the write lock without waiting
+    /// \return true if upgraded, false if there are other readers. In this case the upgradable read lock is still held
+    bool TryUpgradeToWriteLock()
+    {
+        std::uint64_t state = State.load(std::memory_order_relaxed);
+        while ((state & ReaderMask) == 1)
+            if (State.compare_exchange_weak(state, state - 1 + (WaitingWriter | WriterBit), std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                Statistics.OnReadRelease();
+                Statistics.OnWriteAcquire(Statistics.Now(), false);
+                BeginWriteVersion();
+                LockOrderChecker::OnConvert(this, true);
+                return true;
+            }
+
+        return false;
+    }
+
+    /**
+        \brief A method for downgrading the write lock to the read lock
+
+        The writer becomes a usual reader in one atomic step, so no other writer can get into the code section between them.
+        Stopped readers are let in together with this thread. Must be unlocked with ReadUnlock.
+    */
+    void DowngradeToReadLock()
+    {
+        LockOrderChecker::OnConvert(this, false);
+        EndWriteVersion();
+        Statistics.OnWriteRelease();
+        std::uint64_t state = State.fetch_sub((WriterBit | WaitingWriter) - 1, std::memory_order_acq_rel) - ((WriterBit | WaitingWriter) - 1);
+        Statistics.OnReadAcquire(state & ReaderMask);
+        WriteMutex.unlock();
+
+        if (!IsReaderStopped(state))
+            WakeStoppedReaders();
+    }
+
+    /**
+        \brief A method for downgrading the write lock to the upgradable read lock
+
+        Same as DowngradeToReadLock, but the thread keeps the right to upgrade again.
+        Must be unlocked with UpgradableReadUnlock.
+    */
+    void DowngradeToUpgradableReadLock()
+    {
+        LockOrderChecker::OnConvert(this, false);
+        EndWriteVersion();
+        Statistics.OnWriteRelease();
+        std::uint64_t state = State.fetch_sub((WriterBit | WaitingWriter) - 1, std::memory_order_acq_rel) - ((WriterBit | WaitingWriter) - 1);
+        Statistics.OnReadAcquire(state & ReaderMask);
+
+        if (!IsReaderStopped(state))
+            WakeStoppedReaders();
+    }
+};
+
+/**
+    \brief A per-thread table of recursion counters
+
+    Stores how many times the current thread locked each RecursiveReadWriteMutex for reading and for writing.
+    First entries are stored inline, so for a few mutexes held at the same time the lookup is a short scan over one array.
+    If the thread holds more mutexes, then other entries are stored in the fallback map.
+    The entry is removed when the thread unlocks the mutex completely.
+*/
+class RecursionTable
+{
+public:
+    /// \brief Recursion counters of one mutex
+    struct Counters
+    {
+        std::size_t ReadLockCounter = 0;
+        std::size_t WriteLockCounter = 0;
+    };
+
+private:
+    static constexpr std::size_t InlineEntriesAmount = 8;
+
+    struct Entry
+    {
+        const void* Mutex = nullptr;
+        Counters Value;
+    };
+
+    Entry InlineEntries[InlineEntriesAmount];
+
+    // Entries that do not fit into the inline array
+    std::unordered_map<const void*, Counters> FallbackMap;
+
+public:
+    /// \brief Method for getting the counters of the mutex. Zero counters are added if there are no counters for this mutex
+    /// \param [in] mutex mutex address
+    /// \return reference to the counters. It is valid until the entry is removed
+    Counters& Get(const void* mutex)
+    {
+        for (Entry& entry : InlineEntries)
+            if (entry.Mutex == mutex)
+                return entry.Value;
+
+        if (!FallbackMap.empty())
+        {
+            auto it = FallbackMap.find(mutex);
+            if (it != FallbackMap.end())
+                return it->second;
+        }
+
+        for (Entry& entry : InlineEntries)
+            if (entry.Mutex == nullptr)
+            {
+                entry.Mutex = mutex;
+                return entry.Value;
+            }
+
+        return FallbackMap[mutex];
+    }
+
+    /// \brief Method for removing the counters of the mutex
+    /// \param [in] mutex mutex address
+    void Remove(const void* mutex)
+    {
+        for (Entry& entry : InlineEntries)
+            if (entry.Mutex == mutex)
+            {
+                entry.Mutex = nullptr;
+                entry.Value = Counters();
+                return;
+            }
+
+        FallbackMap.erase(mutex);
+    }
+};
+
+/**
+    \brief A class for synchronizing threads
+
+    A class for thread management that allows you to lock sections of code for reading or writing.
+    A write lock will ensure that there can only be one thread in the code section at a time.
+    The read lock will ensure that no thread using the write lock gets into the code section until all threads using the read lock are unblocked.
+    At the same time, after the write lock, no new threads with a read lock will enter the code section until all threads using the write lock are unblocked.
+    Recursiveness allows you to call blocking methods in the same thread multiple times without self-locking.
+    Recursion is tracked for each pair of thread and mutex, so holding one mutex does not affect the others.
+
+    \tparam FairnessPolicy fairness policy of the underlying ReadWriteMutex. By default writers take precedence over the readers
+*/
+template <class FairnessPolicy = WriterPreferringPolicy>
+class RecursiveReadWriteMutex : public SharedTimedMutexInterface<RecursiveReadWriteMutex<FairnessPolicy>>
+{
+private:
+    ReadWriteMutex<FairnessPolicy> Rwmx;
+
+    static RecursionTable& GetLocalThreadRecursionTable()
+    {
+        thread_local RecursionTable recursionTable;
+        return recursionTable;
+    }
+
+    // Removes the counters of this mutex from the table of the current thread if the thread does not hold this mutex
+    void ReleaseCounters(const RecursionTable::Counters& counters)
+    {
+        if (counters.ReadLockCounter == 0 && counters.WriteLockCounter == 0)
+            GetLocalThreadRecursionTable().Remove(this);
+    }
+
+public:
+    /// \brief Method for getting the statistics of the underlying ReadWriteMutex. Only the outermost locks are counted
+    /// \return statistics snapshot. All zeros if LOCK_STATISTICS is not defined
+    LockStatisticsSnapshot GetStatistics() const
+    {
+        return Rwmx.GetStatistics();
+    }
+    
+    /**
+        \brief A method for locking a section of code for reading
+
+        Using this method, you can lock the code section for reading, which means that all threads using the read lock will have access to data inside the code section
+        but threads using the write lock will wait until all read operations are completed.
+        Note that, in fact, blocking for reading inside writing does not make sense, 
+        since the code section is already locked and therefore nothing will happen inside the function in such a situation.
+    */
+    void ReadLock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        RecursionTable::Counters& counters = GetLocalThreadRecursionTable().Get(this);
+
+        if (counters.WriteLockCounter == 0)
+        {
+            if (counters.ReadLockCounter == 0)
+                Rwmx.ReadLock(LOCK_ORDER_SITE_ARGUMENT);
+
+            ++counters.ReadLockCounter;
+        }
+    }
+
+    /// \brief A method for checking if a writer waits for the code section or is inside it. It costs one load
+    /// \return true if a writer waits, so the readers holding the lock for a long time should let it in, for example with ReadSession
+    bool IsWriterWaiting() const
+    {
+        return Rwmx.IsWriterWaiting();
+    }
+
+    /// \brief A method for unlocking a section of code for reading
+    void ReadUnlock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        RecursionTable::Counters& counters = GetLocalThreadRecursionTable().Get(this);
+
+        // Unlock without the lock would make the counter underflow
+        if constexpr (LockOrderChecker::IsEnabled)
+            if (counters.ReadLockCounter == 0 && counters.WriteLockCounter == 0)
+            {
+                LockOrderChecker::Report("read unlock of RecursiveReadWriteMutex not locked by this thread");
+                ReleaseCounters(counters);
+                return;
+            }
+
+        if (counters.WriteLockCounter == 0)
+        {
+            if (counters.ReadLockCounter == 1)
+                Rwmx.ReadUnlock(LOCK_ORDER_SITE_ARGUMENT);
+            
+            --counters.ReadLockCounter;
+        }
+
+        ReleaseCounters(counters);
+    }
+
+    /// \brief A method for trying to lock a section of code for reading without waiting
+    /// \return true if locked or if the current thread already holds the lock, false otherwise
+    bool TryReadLock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        RecursionTable::Counters& counters = GetLocalThreadRecursionTable().Get(this);
+
+        if (counters.WriteLockCounter == 0)
+        {
+            if (counters.ReadLockCounter == 0 && !Rwmx.TryReadLock(LOCK_ORDER_SITE_ARGUMENT))
+            {
+                ReleaseCounters(counters);
+                return false;
+            }
+
+            ++counters.ReadLockCounter;
+        }
+
+        return true;
+    }
+
+    /// \brief A method for trying to lock a section of code for reading until the time point
+    /// \param [in] timePoint time point to wait until
+    /// \return true if locked or if the current thread already holds the lock, false otherwise
+    template <class Clock, class Duration>
+    bool TryReadLockUntil(const std::chrono::time_point<Clock, Duration>& timePoint LOCK_ORDER_SITE_NEXT_PARAMETER)
+    {
+        RecursionTable::Counters& counters = GetLocalThreadRecursionTable().Get(this);
+
+        if (counters.WriteLockCounter == 0)
+        {
+            if (counters.ReadLockCounter == 0 && !Rwmx.TryReadLockUntil(timePoint LOCK_ORDER_SITE_NEXT_ARGUMENT))
+            {
+                ReleaseCounters(counters);
+                return false;
+            }
+
+            ++counters.ReadLockCounter;
+        }
+
+        return true;
+    }
+
+    /**
+        \brief A method for locking a section of code for writing
+
+        This method provides exclusive access to a section of code for a single thread.
+        All write operations will be performed sequentially.
+        This method takes precedence over the read lock, which means that after calling this method, no new read operations will be started.
+        Note that if the write lock is called inside the read lock, then this will be equivalent to unlocking for reading and then locking for writing,
+        so another writer can change data in between. Use ReadWriteMutex::UpgradableReadLock if the upgrade must be atomic.
+    */
+    void WriteLock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        RecursionTable::Counters& counters = GetLocalThreadRecursionTable().Get(this);
+
+        if (counters.WriteLockCounter == 0)
+        {
+            if (counters.ReadLockCounter > 0)
+                Rwmx.ReadUnlock(LOCK_ORDER_SITE_ARGUMENT);
+            
+            Rwmx.WriteLock(LOCK_ORDER_SITE_ARGUMENT);
+        }
+
+        ++counters.WriteLockCounter;
+    }
+
+    /**
+        \brief A method for trying to lock a section of code for writing without waiting
+
+        Note that if the method is called inside the read lock, then the read lock is unlocked before the try.
+        If the try fails, then the read lock is locked again, and this may wait for other writers.
+
+        \return true if locked or if the current thread already holds the write lock, false otherwise
+    */
+    bool TryWriteLock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        RecursionTable::Counters& counters = GetLocalThreadRecursionTable().Get(this);
+
+        if (counters.WriteLockCounter == 0)
+        {
+            if (counters.ReadLockCounter > 0)
+                Rwmx.ReadUnlock(LOCK_ORDER_SITE_ARGUMENT);
+
+            if (!Rwmx.TryWriteLock(LOCK_ORDER_SITE_ARGUMENT))
+            {
+                if (counters.ReadLockCounter > 0)
+                    Rwmx.ReadLock(LOCK_ORDER_SITE_ARGUMENT);
+
+                ReleaseCounters(counters);
+                return false;
+            }
+        }
+
+        ++counters.WriteLockCounter;
+        return true;
+    }
+
+    /**
+        \brief A method for trying to lock a section of code for writing until the time point
+
+        Note that if the method is called inside the read lock, then the read lock is unlocked before the try.
+        If the try fails, then the read lock is locked again, and this may wait for other writers.
+
+        \param [in] timePoint time point to wait until
+        \return true if locked or if the current thread already holds the write lock, false otherwise
+    */
+    template <class Clock, class Duration>
+    bool TryWriteLockUntil(const std::chrono::time_point<Clock, Duration>& timePoint LOCK_ORDER_SITE_NEXT_PARAMETER)
+    {
+        RecursionTable::Counters& counters = GetLocalThreadRecursionTable().Get(this);
+
+        if (counters.WriteLockCounter == 0)
+        {
+            if (counters.ReadLockCounter > 0)
+                Rwmx.ReadUnlock(LOCK_ORDER_SITE_ARGUMENT);
+
+            if (!Rwmx.TryWriteLockUntil(timePoint LOCK_ORDER_SITE_NEXT_ARGUMENT))
+            {
+                if (counters.ReadLockCounter > 0)
+                    Rwmx.ReadLock(LOCK_ORDER_SITE_ARGUMENT);
+
+                ReleaseCounters(counters);
+                return false;
+            }
+        }
+
+        ++counters.WriteLockCounter;
+        return true;
+    }
+
+    /// \brief A method for unlocking a section of code for writing
+    /// Note that if the write unlock is called inside the read lock, then this will be equivalent to unlocking for writing and then locking for reading.
+    void WriteUnlock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        RecursionTable::Counters& counters = GetLocalThreadRecursionTable().Get(this);
+
+        if constexpr (LockOrderChecker::IsEnabled)
+            if (counters.WriteLockCounter == 0)
+            {
+                LockOrderChecker::Report("write unlock of RecursiveReadWriteMutex not locked for writing by this thread");
+                ReleaseCounters(counters);
+                return;
+            }
+
+        if (counters.WriteLockCounter == 1)
+        {
+            Rwmx.WriteUnlock(LOCK_ORDER_SITE_ARGUMENT);
+            if (counters.ReadLockCounter > 0)
+                Rwmx.ReadLock(LOCK_ORDER_SITE_ARGUMENT);
+        }
+        --counters.WriteLockCounter;
+
+        ReleaseCounters(counters);
+    }
+};
+
+/**
+    \brief A class for synchronizing threads with sharded reader counters
+
+    The same read and write locks as in ReadWriteMutex, but the reader counter is split into cache line sized slots.
+    Each thread is bound to one slot, so readers on different cores do not touch the same cache line.
+    The write lock raises a writer flag and waits until all slots become empty, so it is more expensive than in ReadWriteMutex.
+    Use it when there are a lot of readers on a lot of cores and writes are rare.
+    Note that the read lock must be unlocked in the same thread where it was locked.
+*/
+class ShardedReadWriteMutex : public SharedTimedMutexInterface<ShardedReadWriteMutex>
+{
+private:
+    static constexpr std::size_t SlotsAmount = 64;
+
+    // Reader counter padded to the whole cache line
+    struct alignas(CacheLineSize) ReaderSlot
+    {
+        std::atomic<unsigned> Counter{0};
+    };
+
+    ReaderSlot Slots[SlotsAmount];
+
+    // Flag to stop new readers. Set only by the writer owning WriteMutex
+    alignas(CacheLineSize) std::atomic<unsigned> WriterFlag;
+
+    // Mutex to serialize writers
+    std::timed_mutex WriteMutex;
+
+    // Spin-then-park strategies for stopped readers and for the writer waiting for readers
+    AdaptiveWaiter ReaderWaiter, WriterWaiter;
+
+    // Statistics collector. Empty if LOCK_STATISTICS is not defined
+    [[no_unique_address]] LockStatistics Statistics;
+
+    // Returns the slot of the current thread. Slots are given to threads in round-robin order
+    static std::size_t GetThreadSlotIndex()
+    {
+        static std::atomic<std::size_t> nextSlotIndex(0);
+        thread_local std::size_t slotIndex = nextSlotIndex.fetch_add(1, std::memory_order_relaxed) % SlotsAmount;
+        return slotIndex;
+    }
+
+    // Checks if all slots are empty. Called only by the writer owning WriteMutex
+    bool IsSlotsEmpty()
+    {
+        for (ReaderSlot& slot : Slots)
+            if (slot.Counter.load(std::memory_order_seq_cst) != 0)
+                return false;
+
+        return true;
+    }
+
+    // Lowers the writer flag and wakes up the stopped readers
+    void ClearWriterFlag()
+    {
+        WriterFlag.store(0, std::memory_order_release);
+        WriterFlag.notify_all();
+    }
+
+public:
+    /// \brief Default constructor
+    ShardedReadWriteMutex()
+    {
+        WriterFlag.store(0);
+    }
+
+    /// \brief Method for setting the upper bound for spinning before the thread is parked
+    /// \param [in] maxSpinLimit maximum amount of CpuRelax calls before parking. Zero means to park at once
+    void SetMaxSpinLimit(unsigned maxSpinLimit)
+    {
+        ReaderWaiter.SetMaxSpinLimit(maxSpinLimit);
+        WriterWaiter.SetMaxSpinLimit(maxSpinLimit);
+    }
+
+    /// \brief Method for getting the lock statistics
+    /// \return statistics snapshot. All zeros if LOCK_STATISTICS is not defined
+    LockStatisticsSnapshot GetStatistics() const
+    {
+        return Statistics.GetSnapshot();
+    }
+
+    /**
+        \brief A method for locking a section of code for reading
+
+        Using this method, you can lock the code section for reading, which means that all threads using the read lock will have access to data inside the code section
+        but threads using the write lock will wait until all read operations are completed.
+        If there is no writer, then the lock costs one atomic operation on the slot of the current thread.
+    */
+    void ReadLock()
+    {
+        std::atomic<unsigned>& counter = Slots[GetThreadSlotIndex()].Counter;
+        std::uint64_t waitStart = 0;
+
+        for (;;)
+        {
+            // Both operations are sequentially consistent, so either the reader sees the writer flag or the writer sees the reader
+            counter.fetch_add(1, std::memory_order_seq_cst);
+            if (WriterFlag.load(std::memory_order_seq_cst) == 0)
+            {
+                if (waitStart == 0)
+                    Statistics.OnReadAcquire(0);
+                else
+                    Statistics.OnContendedReadAcquire(waitStart, 0);
+                return;
+            }
+
+            if (waitStart == 0)
+                waitStart = Statistics.Now();
+
+            // Writer is pending or active. Leave the slot and wait for the writer
+            if (counter.fetch_sub(1, std::memory_order_seq_cst) == 1)
+                counter.notify_one();
+
+            ReaderWaiter.Wait([this]() { return WriterFlag.load(std::memory_order_acquire) == 0; },
+                [this]() { WriterFlag.wait(1, std::memory_order_acquire); });
+        }
+    }
+
+    /// \brief A method for trying to lock a section of code for reading without waiting
+    /// \return true if locked, false if a writer stops the readers
+    bool TryReadLock()
+    {
+        std::atomic<unsigned>& counter = Slots[GetThreadSlotIndex()].Counter;
+
+        counter.fetch_add(1, std::memory_order_seq_cst);
+        if (WriterFlag.load(std::memory_order_seq_cst) == 0)
+        {
+            Statistics.OnReadAcquire(0);
+            return true;
+        }
+
+        if (counter.fetch_sub(1, std::memory_order_seq_cst) == 1)
+            counter.notify_one();
+
+        return false;
+    }
+
+    /// \brief A method for trying to lock a section of code for reading until the time point
+    /// \param [in] timePoint time point to wait until
+    /// \return true if locked, false if the time point is reached
+    template <class Clock, class Duration>
+    bool TryReadLockUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        return WaitUntil(timePoint, [this]() { return TryReadLock(); });
+    }
+
+    /// \brief A method for checking if a writer waits for the code section or is inside it. It costs one load
+    /// \return true if a writer waits, so the readers holding the lock for a long time should let it in, for example with ReadSession
+    bool IsWriterWaiting() const
+    {
+        return WriterFlag.load(std::memory_order_relaxed) != 0;
+    }
+
+    /// \brief A method for unlocking a section of code for reading
+    void ReadUnlock()
+    {
+        Statistics.OnReadRelease();
+
+        std::atomic<unsigned>& counter = Slots[GetThreadSlotIndex()].Counter;
+
+        // Last reader in the slot wakes up the pending writer
+        if (counter.fetch_sub(1, std::memory_order_seq_cst) == 1 && WriterFlag.load(std::memory_order_seq_cst) != 0)
+            counter.notify_one();
+    }
+
+    /**
+        \brief A method for locking a section of code for writing
+
+        This method provides exclusive access to a section of code for a single thread.
+        All write operations will be performed sequentially.
+        This method takes precedence over the read lock, which means that after calling this method, no new read operations will be started.
+    */
+    void WriteLock()
+    {
+        std::uint64_t waitStart = Statistics.Now();
+        bool isContended = true;
+
+        if constexpr (LockStatistics::IsEnabled)
+            isContended = !WriteMutex.try_lock();
+        if (isContended)
+            WriteMutex.lock();
+
+        WriterFlag.store(1, std::memory_order_seq_cst);
+
+        if constexpr (LockStatistics::IsEnabled)
+            isContended = !IsSlotsEmpty() || isContended;
+
+        for (ReaderSlot& slot : Slots)
+            WriterWaiter.Wait([&slot]() { return slot.Counter.load(std::memory_order_seq_cst) == 0; },
+                [&slot]()
+                {
+                    unsigned counter = slot.Counter.load(std::memory_order_seq_cst);
+                    if (counter != 0)
+                        slot.Counter.wait(counter, std::memory_order_acquire);
+                });
+
+        Statistics.OnWriteAcquire(waitStart, isContended);
+    }
+
+    /// \brief A method for trying to lock a section of code for writing without waiting
+    /// \return true if locked, false if there is another writer or there are readers in the code section
+    bool TryWriteLock()
+    {
+        if (!WriteMutex.try_lock())
+            return false;
+
+        WriterFlag.store(1, std::memory_order_seq_cst);
+
+        if (IsSlotsEmpty())
+        {
+            Statistics.OnWriteAcquire(Statistics.Now(), false);
+            return true;
+        }
+
+        ClearWriterFlag();
+        WriteMutex.unlock();
+        return false;
+    }
+
+    /// \brief A method for trying to lock a section of code for writing until the time point
+    /// \param [in] timePoint time point to wait until
+    /// \return true if locked, false if the time point is reached
+    template <class Clock, class Duration>
+    bool TryWriteLockUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        if (TryWriteLock())
+            return true;
+
+        std::uint64_t waitStart = Statistics.Now();
+
+        if (!WriteMutex.try_lock_until(timePoint))
+            return false;
+
+        WriterFlag.store(1, std::memory_order_seq_cst);
+
+        if (WaitUntil(timePoint, [this]() { return IsSlotsEmpty(); }))
+        {
+            Statistics.OnWriteAcquire(waitStart, true);
+            return true;
+        }
+
+        ClearWriterFlag();
+        WriteMutex.unlock();
+        return false;
+    }
+
+    /// \brief A method for unlocking a section of code for writing
+    void WriteUnlock()
+    {
+        Statistics.OnWriteRelease();
+        ClearWriterFlag();
+        WriteMutex.unlock();
+    }
+};
+
+/**
+    \brief A NUMA-aware read write lock
+
+    Readers are counted in per-node counters, so readers on different NUMA nodes do not touch the same cache line.
+    Writers use a cohort lock: a local mutex per node and a global lock. When a writer leaves and another writer of the same node waits,
+    the global lock is passed to it without releasing, so the write lock stays inside the node and the readers stay stopped.
+    The global lock is passed inside the node at most MaxLocalHandoffs times in a row, then it is released to let in other nodes and readers.
+    The node of the thread is taken with getcpu on the first lock and cached, so threads should be pinned to the nodes.
+    On other systems all threads are on node 0. Note that the read lock must be unlocked in the same thread where it was locked.
+
+    \tparam MaxNodesAmount maximum amount of NUMA nodes. Nodes with greater numbers share the counters
+*/
+template <std::size_t MaxNodesAmount = 8>
+class NumaReadWriteMutex : public SharedTimedMutexInterface<NumaReadWriteMutex<MaxNodesAmount>>
+{
+private:
+    static_assert(MaxNodesAmount > 0, "NumaReadWriteMutex: amount of nodes must be positive");
+
+    static constexpr unsigned MaxLocalHandoffs = 64;
+
+    // Reader counter and the local writer lock of one node padded to whole cache lines
+    struct alignas(CacheLineSize) Node
+    {
+        std::atomic<unsigned> Readers{0};
+
+        // Amount of writers of the node blocked on LocalMutex. Timed writers are not counted, so they never get the global lock passed
+        std::atomic<unsigned> WaitingWriters{0};
+
+        std::timed_mutex LocalMutex;
+
+        // True if the previous writer of the node passed the global lock. Changed only by the writer owning LocalMutex
+        bool HasGlobalLock = false;
+
+        // Amount of passes of the global lock inside the node in a row. Changed only by the writer owning LocalMutex
+        unsigned Handoffs = 0;
+    };
+
+    Node Nodes[MaxNodesAmount];
+
+    // Global writer lock. It can be unlocked by another thread than locked, so it is an atomic instead of a mutex
+    alignas(CacheLineSize) std::atomic<unsigned> GlobalLock;
+
+    // Flag to stop new readers. Set only by the writer owning the global lock
+    std::atomic<unsigned> WriterFlag;
+
+    // Node of the current writer. Changed only by the writer
+    std::size_t WriterNode = 0;
+
+    // Spin-then-park strategies for stopped readers and for the writer waiting for readers
+    AdaptiveWaiter ReaderWaiter, WriterWaiter;
+
+    // Statistics collector. Empty if LOCK_STATISTICS is not defined
+    [[no_unique_address]] LockStatistics Statistics;
+
+    static std::size_t GetCurrentNode()
+    {
+#if defined __linux__
+        unsigned cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+            return node;
+#endif
+        return 0;
+    }
+
+    // Returns the node of the current thread. It is taken once per thread
+    static std::size_t GetThreadNode()
+    {
+        thread_local std::size_t node = GetCurrentNode() % MaxNodesAmount;
+        return node;
+    }
+
+    bool TryLockGlobal()
+    {
+        return GlobalLock.exchange(1, std::memory_order_acquire) == 0;
+    }
+
+    void UnlockGlobal()
+    {
+        GlobalLock.store(0, std::memory_order_release);
+        GlobalLock.notify_one();
+    }
+
+    // Checks if all nodes have no readers. Called only by the writer owning the global lock
+    bool IsReadersEmpty()
+    {
+        for (Node& node : Nodes)
+            if (node.Readers.load(std::memory_order_seq_cst) != 0)
+                return false;
+
+        return true;
+    }
+
+    // Lowers the writer flag and wakes up the stopped readers
+    void ClearWriterFlag()
+    {
+        WriterFlag.store(0, std::memory_order_release);
+        WriterFlag.notify_all();
+    }
+
+public:
+    /// \brief Default constructor
+    NumaReadWriteMutex()
+    {
+        GlobalLock.store(0);
+        WriterFlag.store(0);
+    }
+
+    /// \brief Method for setting the upper bound for spinning before the thread is parked
+    /// \param [in] maxSpinLimit maximum amount of CpuRelax calls before parking. Zero means to park at once
+    void SetMaxSpinLimit(unsigned maxSpinLimit)
+    {
+        ReaderWaiter.SetMaxSpinLimit(maxSpinLimit);
+        WriterWaiter.SetMaxSpinLimit(maxSpinLimit);
+    }
+
+    /// \brief Method for getting the lock statistics
+    /// \return statistics snapshot. All zeros if LOCK_STATISTICS is not defined
+    LockStatisticsSnapshot GetStatistics() const
+    {
+        return Statistics.GetSnapshot();
+    }
+
+    /// \brief A method for locking a section of code for reading.
+    /// If there is no writer, then the lock costs one atomic operation on the counter of the current node
+    void ReadLock()
+    {
+        std::atomic<unsigned>& counter = Nodes[GetThreadNode()].Readers;
+        std::uint64_t waitStart = 0;
+
+        for (;;)
+        {
+            // Both operations are sequentially consistent, so either the reader sees the writer flag or the writer sees the reader
+            counter.fetch_add(1, std::memory_order_seq_cst);
+            if (WriterFlag.load(std::memory_order_seq_cst) == 0)
+            {
+                if (waitStart == 0)
+                    Statistics.OnReadAcquire(0);
+                else
+                    Statistics.OnContendedReadAcquire(waitStart, 0);
+                return;
+            }
+
+            if (waitStart == 0)
+                waitStart = Statistics.Now();
+
+            // Writer is pending or active. Leave the node and wait for the writer
+            if (counter.fetch_sub(1, std::memory_order_seq_cst) == 1)
+                counter.notify_one();
+
+            ReaderWaiter.Wait([this]() { return WriterFlag.load(std::memory_order_acquire) == 0; },
+                [this]() { WriterFlag.wait(1, std::memory_order_acquire); });
+        }
+    }
+
+    /// \brief A method for trying to lock a section of code for reading without waiting
+    /// \return true if locked, false if a writer stops the readers
+    bool TryReadLock()
+    {
+        std::atomic<unsigned>& counter = Nodes[GetThreadNode()].Readers;
+
+        counter.fetch_add(1, std::memory_order_seq_cst);
+        if (WriterFlag.load(std::memory_order_seq_cst) == 0)
+        {
+            Statistics.OnReadAcquire(0);
+            return true;
+        }
+
+        if (counter.fetch_sub(1, std::memory_order_seq_cst) == 1)
+            counter.notify_one();
+
+        return false;
+    }
+
+    /// \brief A method for trying to lock a section of code for reading until the time point
+    /// \param [in] timePoint time point to wait until
+    /// \return true if locked, false if the time point is reached
+    template <class Clock, class Duration>
+    bool TryReadLockUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        return WaitUntil(timePoint, [this]() { return TryReadLock(); });
+    }
+
+    /// \brief A method for checking if a writer waits for the code section or is inside it. It costs one load
+    /// \return true if a writer waits, so the readers holding the lock for a long time should let it in, for example with ReadSession
+    bool IsWriterWaiting() const
+    {
+        return WriterFlag.load(std::memory_order_relaxed) != 0;
+    }
+
+    /// \brief A method for unlocking a section of code for reading
+    void ReadUnlock()
+    {
+        Statistics.OnReadRelease();
+
+        std::atomic<unsigned>& counter = Nodes[GetThreadNode()].Readers;
+
+        // Last reader of the node wakes up the writer waiting for this node.
+        // Both operations are seq_cst against the flag store and the counter load of the writer, so one of them sees the other
+        if (counter.fetch_sub(1, std::memory_order_seq_cst) == 1 && WriterFlag.load(std::memory_order_seq_cst) != 0)
+            counter.notify_one();
+    }
+
+    /// \brief A method for locking a section of code for writing.
+    /// If the previous writer was on the same node, then the global lock and the drained readers are taken over from it
+    void WriteLock()
+    {
+        std::uint64_t waitStart = Statistics.Now();
+        std::size_t nodeIndex = GetThreadNode();
+        Node& node = Nodes[nodeIndex];
+
+        node.WaitingWriters.fetch_add(1, std::memory_order_relaxed);
+        node.LocalMutex.lock();
+        node.WaitingWriters.fetch_sub(1, std::memory_order_relaxed);
+
+        bool isContended = true;
+        if (!node.HasGlobalLock)
+        {
+            isContended = false;
+            while (!TryLockGlobal())
+            {
+                isContended = true;
+                WriterWaiter.Wait([this]() { return GlobalLock.load(std::memory_order_relaxed) == 0; },
+                    [this]() { GlobalLock.wait(1, std::memory_order_relaxed); });
+            }
+
+            WriterFlag.store(1, std::memory_order_seq_cst);
+
+            isContended = !IsReadersEmpty() || isContended;
+            for (Node& readersNode : Nodes)
+                WriterWaiter.Wait([&readersNode]() { return readersNode.Readers.load(std::memory_order_seq_cst) == 0; },
+                    [&readersNode]()
+                    {
+                        unsigned counter = readersNode.Readers.load(std::memory_order_acquire);
+                        if (counter != 0)
+                            readersNode.Readers.wait(counter, std::memory_order_acquire);
+                    });
+        }
+
+        WriterNode = nodeIndex;
+        Statistics.OnWriteAcquire(waitStart, isContended);
+    }
+
+    /// \brief A method for trying to lock a section of code for writing without waiting
+    /// \return true if locked, false otherwise
+    bool TryWriteLock()
+    {
+        std::size_t nodeIndex = GetThreadNode();
+        Node& node = Nodes[nodeIndex];
+
+        if (!node.LocalMutex.try_lock())
+            return false;
+
+        if (!node.HasGlobalLock)
+        {
+            if (!TryLockGlobal())
+            {
+                node.LocalMutex.unlock();
+                return false;
+            }
+
+            WriterFlag.store(1, std::memory_order_seq_cst);
+
+            if (!IsReadersEmpty())
+            {
+                ClearWriterFlag();
+                UnlockGlobal();
+                node.LocalMutex.unlock();
+                return false;
+            }
+        }
+
+        WriterNode = nodeIndex;
+        Statistics.OnWriteAcquire(Statistics.Now(), false);
+        return true;
+    }
+
+    /// \brief A method for trying to lock a section of code for writing until the time point
+    /// \param [in] timePoint time point to wait until
+    /// \return true if locked, false if the time point is reached
+    template <class Clock, class Duration>
+    bool TryWriteLockUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        if (TryWriteLock())
+            return true;
+
+        std::uint64_t waitStart = Statistics.Now();
+        std::size_t nodeIndex = GetThreadNode();
+        Node& node = Nodes[nodeIndex];
+
+        if (!node.LocalMutex.try_lock_until(timePoint))
+            return false;
+
+        if (!node.HasGlobalLock)
+        {
+            if (!WaitUntil(timePoint, [this]() { return TryLockGlobal(); }))
+            {
+                node.LocalMutex.unlock();
+                return false;
+            }
+
+            WriterFlag.store(1, std::memory_order_seq_cst);
+
+            if (!WaitUntil(timePoint, [this]() { return IsReadersEmpty(); }))
+            {
+                ClearWriterFlag();
+                UnlockGlobal();
+                node.LocalMutex.unlock();
+                return false;
+            }
+        }
+
+        WriterNode = nodeIndex;
+        Statistics.OnWriteAcquire(waitStart, true);
+        return true;
+    }
+
+    /// \brief A method for unlocking a section of code for writing
+    void WriteUnlock()
+    {
+        Statistics.OnWriteRelease();
+
+        Node& node = Nodes[WriterNode];
+
+        // Pass the global lock to the next writer of the node
+        if (node.WaitingWriters.load(std::memory_order_relaxed) != 0 && node.Handoffs < MaxLocalHandoffs)
+        {
+            ++node.Handoffs;
+            node.HasGlobalLock = true;
+            node.LocalMutex.unlock();
+            return;
+        }
+
+        node.Handoffs = 0;
+        node.HasGlobalLock = false;
+        ClearWriterFlag();
+        UnlockGlobal();
+        node.LocalMutex.unlock();
+    }
+};
+
+/**
+    \brief A read write lock with the priority queue of writers
+
+    Waiting writers are stored in the explicit queue ordered by priority and then by arrival, so writers of the same priority are served in FIFO order
+    and a high priority writer goes before all waiting writers of lower priority. The unlocking writer hands the lock directly to the first writer of the queue.
+    Each waiter has its own queue node aligned to the cache line and waits on it, as in MCS lock, so waiting writers do not touch the shared cache lines.
+    The queue itself is protected by a short spin lock, which allows timed writers to leave the queue.
+    Readers also have priorities: a reader waits for writers with the same or higher priority, but enters before waiting writers of lower priority.
+    So latency critical threads with high priority wait only for the active writer.
+    The priority of the waiting thread is not given to the holder, since std::thread has no portable way to change the thread priority.
+
+    Priorities must be greater than the minimum int value. Default priority is zero.
+*/
+class PriorityReadWriteMutex : public SharedTimedMutexInterface<PriorityReadWriteMutex>
+{
+private:
+    static constexpr int NoPriority = std::numeric_limits<int>::min();
+
+    // Node of the waiting writer. It lives on the stack of the waiting thread
+    struct alignas(CacheLineSize) WriterNode
+    {
+        int Priority;
+        WriterNode* Next = nullptr;
+
+        // 0 while waiting, 1 while the granting thread wakes up the waiter, 2 when the node is not used by the granting thread anymore
+        std::atomic<unsigned> IsGranted{0};
+
+        explicit WriterNode(int priority) : Priority(priority) {}
+    };
+
+    // Amount of readers inside the lock
+    alignas(CacheLineSize) std::atomic<unsigned> Readers;
+
+    // Set while the writer is inside the lock or waits for the readers to leave it
+    std::atomic<unsigned> WriterFlag;
+
+    // Highest priority of the holding and waiting writers. Readers with the same or lower priority wait
+    std::atomic<int> WriterPriority;
+
+    // Incremented each time when stopped readers can enter. Stopped readers wait on it
+    std::atomic<unsigned> ReaderGate;
+
+    // Flag to protect the queue. It is held only for a few instructions
+    alignas(CacheLineSize) std::atomic_flag QueueFlag = ATOMIC_FLAG_INIT;
+
+    // True if a writer owns the lock. Changed only with the queue locked
+    bool IsWriterOwner = false;
+
+    // Priority of the owning writer. Changed only with the queue locked
+    int OwnerPriority = NoPriority;
+
+    // Waiting writers ordered by priority. Changed only with the queue locked
+    WriterNode* Head = nullptr;
+
+    // Spin-then-park strategies for waiting threads
+    AdaptiveWaiter ReaderWaiter, WriterWaiter;
+
+    // Statistics collector. Empty if LOCK_STATISTICS is not defined
+    [[no_unique_address]] LockStatistics Statistics;
+
+    void LockQueue()
+    {
+        while (QueueFlag.test_and_set(std::memory_order_acquire))
+            while (QueueFlag.test(std::memory_order_relaxed))
+                CpuRelax();
+    }
+
+    void UnlockQueue()
+    {
+        QueueFlag.clear(std::memory_order_release);
+    }
+
+    // Recalculates the writer priority for readers. Called only with the queue locked
+    void UpdateWriterPriority()
+    {
+        int priority = IsWriterOwner ? OwnerPriority : NoPriority;
+        if (Head != nullptr)
+            priority = std::max(priority, Head->Priority);
+
+        WriterPriority.store(priority, std::memory_order_seq_cst);
+    }
+
+    // Wakes up the stopped readers to check the state again
+    void OpenReaderGate()
+    {
+        ReaderGate.fetch_add(1, std::memory_order_seq_cst);
+        ReaderGate.notify_all();
+    }
+
+    // Adds the node after the nodes with the same or higher priority. Called only with the queue locked
+    void Enqueue(WriterNode& node)
+    {
+        WriterNode** place = &Head;
+        while (*place != nullptr && (*place)->Priority >= node.Priority)
+            place = &(*place)->Next;
+
+        node.Next = *place;
+        *place = &node;
+    }
+
+    // Removes the node that is still waiting. Called only with the queue locked
+    void Dequeue(WriterNode& node)
+    {
+        WriterNode** place = &Head;
+        while (*place != &node)
+            place = &(*place)->Next;
+
+        *place = node.Next;
+    }
+
+    // Takes the free lock or puts the node to the queue. Returns true if the lock is taken
+    bool AcquireOrEnqueue(WriterNode& node)
+    {
+        LockQueue();
+
+        bool isAcquired = !IsWriterOwner;
+        if (isAcquired)
+        {
+            IsWriterOwner = true;
+            OwnerPriority = node.Priority;
+        }
+        else
+            Enqueue(node);
+
+        UpdateWriterPriority();
+        UnlockQueue();
+        return isAcquired;
+    }
+
+    // Waits until all readers leave the lock
+    void WaitForReaders()
+    {
+        WriterWaiter.Wait([this]() { return Readers.load(std::memory_order_seq_cst) == 0; },
+            [this]()
+            {
+                unsigned readers = Readers.load(std::memory_order_acquire);
+                if (readers != 0)
+                    Readers.wait(readers, std::memory_order_acquire);
+            });
+    }
+
+    // Gives the lock to the first waiting writer or frees it
+    void HandOff()
+    {
+        LockQueue();
+
+        WriterNode* next = Head;
+        if (next != nullptr)
+        {
+            Head = next->Next;
+            OwnerPriority = next->Priority;
+        }
+        else
+        {
+            IsWriterOwner = false;
+            OwnerPriority = NoPriority;
+        }
+
+        UpdateWriterPriority();
+
+        // The node must be granted with the queue locked, so the timed waiter either leaves the queue or sees the grant
+        if (next != nullptr)
+            next->IsGranted.store(1, std::memory_order_release);
+
+        UnlockQueue();
+
+        if (next != nullptr)
+        {
+            next->IsGranted.notify_one();
+            next->IsGranted.store(2, std::memory_order_release);
+        }
+
+        OpenReaderGate();
+    }
+
+    // Takes the write lock after it was given to this thread
+    void EnterWriter()
+    {
+        WriterFlag.store(1, std::memory_order_seq_cst);
+    }
+
+    // Waits until the granting thread stops using the node
+    static void WaitForNodeRelease(WriterNode& node)
+    {
+        for (unsigned i = 0; node.IsGranted.load(std::memory_order_acquire) != 2; ++i)
+            if (i < 64)
+                CpuRelax();
+            else
+                std::this_thread::yield();
+    }
+
+public:
+    /// \brief Default constructor
+    PriorityReadWriteMutex()
+    {
+        Readers.store(0);
+        WriterFlag.store(0);
+        WriterPriority.store(NoPriority);
+        ReaderGate.store(0);
+    }
+
+    /// \brief Method for setting the upper bound for spinning before the thread is parked
+    /// \param [in] maxSpinLimit maximum amount of CpuRelax calls before parking. Zero means to park at once
+    void SetMaxSpinLimit(unsigned maxSpinLimit)
+    {
+        ReaderWaiter.SetMaxSpinLimit(maxSpinLimit);
+        WriterWaiter.SetMaxSpinLimit(maxSpinLimit);
+    }
+
+    /// \brief Method for getting the lock statistics
+    /// \return statistics snapshot. All zeros if LOCK_STATISTICS is not defined
+    LockStatisticsSnapshot GetStatistics() const
+    {
+        return Statistics.GetSnapshot();
+    }
+
+    /// \brief A method for locking a section of code for reading
+    /// \param [in] priority reader priority. The reader waits only for the active writer and the writers with the same or higher priority
+    void ReadLock(int priority = 0)
+    {
+        std::uint64_t waitStart = 0;
+
+        for (;;)
+        {
+            // Gate is read before the check, so the change after the check opens the gate
+            unsigned gate = ReaderGate.load(std::memory_order_seq_cst);
+
+            unsigned readers = Readers.fetch_add(1, std::memory_order_seq_cst) + 1;
+            if (WriterFlag.load(std::memory_order_seq_cst) == 0 && priority > WriterPriority.load(std::memory_order_seq_cst))
+            {
+                if (waitStart == 0)
+                    Statistics.OnReadAcquire(readers);
+                else
+                    Statistics.OnContendedReadAcquire(waitStart, readers);
+                return;
+            }
+
+            if (waitStart == 0)
+                waitStart = Statistics.Now();
+
+            if (Readers.fetch_sub(1, std::memory_order_seq_cst) == 1)
+                Readers.notify_one();
+
+            ReaderWaiter.Wait([this, gate]() { return ReaderGate.load(std::memory_order_acquire) != gate; },
+                [this, gate]() { ReaderGate.wait(gate, std::memory_order_acquire); });
+        }
+    }
+
+    /// \brief A method for trying to lock a section of code for reading without waiting
+    /// \param [in] priority reader priority
+    /// \return true if locked, false if a writer stops the reader
+    bool TryReadLock(int priority = 0)
+    {
+        unsigned readers = Readers.fetch_add(1, std::memory_order_seq_cst) + 1;
+        if (WriterFlag.load(std::memory_order_seq_cst) == 0 && priority > WriterPriority.load(std::memory_order_seq_cst))
+        {
+            Statistics.OnReadAcquire(readers);
+            return true;
+        }
+
+        if (Readers.fetch_sub(1, std::memory_order_seq_cst) == 1)
+            Readers.notify_one();
+
+        return false;
+    }
+
+    /// \brief A method for trying to lock a section of code for reading until the time point
+    /// \param [in] timePoint time point to wait until
+    /// \param [in] priority reader priority
+    /// \return true if locked, false if the time point is reached
+    template <class Clock, class Duration>
+    bool TryReadLockUntil(const std::chrono::time_point<Clock, Duration>& timePoint, int priority = 0)
+    {
+        return WaitUntil(timePoint, [this, priority]() { return TryReadLock(priority); });
+    }
+
+    /// \brief A method for checking if a writer waits for the code section or is inside it. It costs one load
+    /// \return true if a writer waits, so the readers holding the lock for a long time should let it in, for example with ReadSession
+    bool IsWriterWaiting() const
+    {
+        return WriterFlag.load(std::memory_order_relaxed) != 0 || WriterPriority.load(std::memory_order_relaxed) != NoPriority;
+    }
+
+    /// \brief A method for unlocking a section of code for reading
+    void ReadUnlock()
+    {
+        Statistics.OnReadRelease();
+
+        // Last reader wakes up the writer waiting for the readers.
+        // Both operations are seq_cst against the flag store and the counter load of the writer, so one of them sees the other
+        if (Readers.fetch_sub(1, std::memory_order_seq_cst) == 1 && WriterFlag.load(std::memory_order_seq_cst) != 0)
+            Readers.notify_one();
+    }
+
+    /// \brief A method for locking a section of code for writing
+    /// \param [in] priority writer priority. The writer goes before all waiting writers with lower priority
+    void WriteLock(int priority = 0)
+    {
+        std::uint64_t waitStart = Statistics.Now();
+        WriterNode node(priority);
+
+        bool isContended = !AcquireOrEnqueue(node);
+        if (isContended)
+        {
+            WriterWaiter.Wait([&node]() { return node.IsGranted.load(std::memory_order_acquire) != 0; },
+                [&node]() { node.IsGranted.wait(0, std::memory_order_acquire); });
+            WaitForNodeRelease(node);
+        }
+
+        EnterWriter();
+        isContended = Readers.load(std::memory_order_seq_cst) != 0 || isContended;
+        WaitForReaders();
+        Statistics.OnWriteAcquire(waitStart, isContended);
+    }
+
+    /// \brief A method for trying to lock a section of code for writing without waiting
+    /// \param [in] priority writer priority
+    /// \return true if locked, false if there is another writer or there are readers in the code section
+    bool TryWriteLock(int priority = 0)
+    {
+        LockQueue();
+        if (IsWriterOwner)
+        {
+            UnlockQueue();
+            return false;
+        }
+
+        IsWriterOwner = true;
+        OwnerPriority = priority;
+        UpdateWriterPriority();
+        UnlockQueue();
+
+        EnterWriter();
+        if (Readers.load(std::memory_order_seq_cst) != 0)
+        {
+            WriterFlag.store(0, std::memory_order_release);
+            HandOff();
+            return false;
+        }
+
+        Statistics.OnWriteAcquire(Statistics.Now(), false);
+        return true;
+    }
+
+    /**
+        \brief A method for trying to lock a section of code for writing until the time point
+
+        The writer waits in the queue like WriteLock. If the time point is reached, the writer leaves the queue.
+
+        \param [in] timePoint time point to wait until
+        \param [in] priority writer priority
+        \return true if locked, false if the time point is reached
+    */
+    template <class Clock, class Duration>
+    bool TryWriteLockUntil(const std::chrono::time_point<Clock, Duration>& timePoint, int priority = 0)
+    {
+        std::uint64_t waitStart = Statistics.Now();
+        WriterNode node(priority);
+
+        if (!AcquireOrEnqueue(node) && !WaitUntil(timePoint, [&node]() { return node.IsGranted.load(std::memory_order_acquire) != 0; }))
+        {
+            LockQueue();
+            bool isGranted = node.IsGranted.load(std::memory_order_acquire) != 0;
+            if (!isGranted)
+            {
+                Dequeue(node);
+                UpdateWriterPriority();
+            }
+            UnlockQueue();
+
+            if (!isGranted)
+            {
+                // Readers stopped by the priority of this writer can enter now
+                OpenReaderGate();
+                return false;
+            }
+
+            // The lock was given right at the time point, so release it properly
+            WaitForNodeRelease(node);
+            HandOff();
+            return false;
+        }
+
+        if (node.IsGranted.load(std::memory_order_acquire) != 0)
+            WaitForNodeRelease(node);
+
+        EnterWriter();
+        if (!WaitUntil(timePoint, [this]() { return Readers.load(std::memory_order_seq_cst) == 0; }))
+        {
+            WriterFlag.store(0, std::memory_order_release);
+            HandOff();
+            return false;
+        }
+
+        Statistics.OnWriteAcquire(waitStart, true);
+        return true;
+    }
+
+    /// \brief A method for unlocking a section of code for writing. The lock is given to the first writer of the queue
+    void WriteUnlock()
+    {
+        Statistics.OnWriteRelease();
+
+        // Readers with higher priority than the next writer can enter before it
+        WriterFlag.store(0, std::memory_order_release);
+        HandOff();
+    }
+};
+
+/**
+    \brief A table of read write locks for a lot of small objects
+
+    Instead of a ReadWriteMutex in each object, objects are hashed by a key onto N lock stripes.
+    The key can be any type with std::hash, for example the object address. So the memory for locks does not depend on the amount of objects.
+    Objects hashed onto the same stripe share the lock, so N should be much more than the amount of threads.
+    Several keys can be locked for writing at once, stripes are locked in ascending order, so such locks do not deadlock with each other.
+    A stripe from GetStripe can be used with ReadLock and WriteLock guards.
+
+    \tparam N amount of stripes
+    \tparam FairnessPolicy fairness policy of the stripes
+*/
+template <std::size_t N, class FairnessPolicy = WriterPreferringPolicy>
+class StripedReadWriteMutex
+{
+private:
+    static_assert(N > 0, "StripedReadWriteMutex: amount of stripes must be positive");
+
+    // Locks padded to whole cache lines, so neighbouring stripes do not share a cache line
+    CacheAlignedArray<ReadWriteMutex<FairnessPolicy>, N> Stripes;
+
+    // Mixes the hash, since std::hash of pointers and integers is usually the value itself
+    template <class Key>
+    static std::size_t GetStripeIndex(const Key& key)
+    {
+        std::uint64_t hash = static_cast<std::uint64_t>(std::hash<Key>()(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<std::size_t>((hash >> 32) % N);
+    }
+
+    // Returns sorted stripe indexes of the keys without repeats
+    template <class... Keys>
+    static std::array<std::size_t, sizeof...(Keys)> GetSortedStripeIndexes(std::size_t& amount, const Keys&... keys)
+    {
+        std::array<std::size_t, sizeof...(Keys)> indexes = { GetStripeIndex(keys)... };
+        std::sort(indexes.begin(), indexes.end());
+        amount = static_cast<std::size_t>(std::unique(indexes.begin(), indexes.end()) - indexes.begin());
+        return indexes;
+    }
+
+public:
+    /// \brief Method for getting the stripe of the key
+    /// \param [in] key object key
+    /// \return lock of the stripe
+    template <class Key>
+    ReadWriteMutex<FairnessPolicy>& GetStripe(const Key& key)
+    {
+        return Stripes[GetStripeIndex(key)];
+    }
+
+    /// \brief A method for locking the object for reading
+    /// \param [in] key object key
+    template <class Key>
+    void ReadLock(const Key& key)
+    {
+        GetStripe(key).ReadLock();
+    }
+
+    /// \brief A method for trying to lock the object for reading without waiting
+    /// \param [in] key object key
+    /// \return true if locked, false otherwise
+    template <class Key>
+    bool TryReadLock(const Key& key)
+    {
+        return GetStripe(key).TryReadLock();
+    }
+
+    /// \brief A method for unlocking the object for reading
+    /// \param [in] key object key
+    template <class Key>
+    void ReadUnlock(const Key& key)
+    {
+        GetStripe(key).ReadUnlock();
+    }
+
+    /**
+        \brief A method for locking the objects for writing
+
+        Stripes are locked in ascending order and each stripe is locked once, even if several keys are hashed onto it.
+
+        \param [in] keys object keys
+    */
+    template <class... Keys>
+    void WriteLock(const Keys&... keys)
+    {
+        std::size_t amount;
+        std::array<std::size_t, sizeof...(Keys)> indexes = GetSortedStripeIndexes(amount, keys...);
+
+        for (std::size_t i = 0; i < amount; ++i)
+            Stripes[indexes[i]].WriteLock();
+    }
+
+    /// \brief A method for trying to lock the objects for writing without waiting
+    /// \param [in] keys object keys
+    /// \return true if all objects are locked, false if none of them are locked
+    template <class... Keys>
+    bool TryWriteLock(const Keys&... keys)
+    {
+        std::size_t amount;
+        std::array<std::size_t, sizeof...(Keys)> indexes = GetSortedStripeIndexes(amount, keys...);
+
+        for (std::size_t i = 0; i < amount; ++i)
+            if (!Stripes[indexes[i]].TryWriteLock())
+            {
+                while (i > 0)
+                    Stripes[indexes[--i]].WriteUnlock();
+                return false;
+            }
+
+        return true;
+    }
+
+    /// \brief A method for unlocking the objects for writing
+    /// \param [in] keys object keys, the same as in WriteLock
+    template <class... Keys>
+    void WriteUnlock(const Keys&... keys)
+    {
+        std::size_t amount;
+        std::array<std::size_t, sizeof...(Keys)> indexes = GetSortedStripeIndexes(amount, keys...);
+
+        for (std::size_t i = amount; i > 0; --i)
+            Stripes[indexes[i - 1]].WriteUnlock();
+    }
+};
+
+/**
+    \brief A read write lock in one 32-bit word
+
+    The word stores the reader counter, the writer bit, the waiting writer bit and the parked bit.
+    Threads spin for a short time and then park on the word itself with std::atomic::wait, and the unlock wakes them only if the parked bit is set.
+    So the lock can be embedded into hash table buckets and tree nodes. Waiting writers stop new readers, like in WriterPreferringPolicy,
+    but there is no queue, so writers waiting for each other do not keep readers stopped, and the wake up wakes all parked threads.
+    Use ReadWriteMutex when the lock is highly contended.
+*/
+class CompactReadWriteMutex : public SharedTimedMutexInterface<CompactReadWriteMutex>
+{
+private:
+    // Lowest 29 bits store the amount of readers.
+    // Parked bit is set when a thread waits on the word, so the unlock has to wake it.
+    // Waiting writer bit stops new readers. Writer bit is set when a writer holds the lock.
+    static constexpr std::uint32_t ReaderMask = 0x1FFFFFFFu;
+    static constexpr std::uint32_t ParkedBit = 0x20000000u;
+    static constexpr std::uint32_t WaitingWriterBit = 0x40000000u;
+    static constexpr std::uint32_t WriterBit = 0x80000000u;
+
+    // Amount of CpuRelax calls before parking
+    static constexpr unsigned SpinLimit = 256;
+
+    std::atomic<std::uint32_t> State{0};
+
+    static constexpr bool IsReaderStopped(std::uint32_t state)
+    {
+        return (state & (WriterBit | WaitingWriterBit)) != 0;
+    }
+
+    static constexpr bool IsWriterStopped(std::uint32_t state)
+    {
+        return (state & (WriterBit | ReaderMask)) != 0;
+    }
+
+    // Spins while the lock is busy. Returns the last state
+    template <class IsStopped>
+    std::uint32_t Spin(IsStopped isStopped)
+    {
+        std::uint32_t state = State.load(std::memory_order_relaxed);
+        for (unsigned i = 0; i < SpinLimit && isStopped(state); ++i)
+        {
+            CpuRelax();
+            state = State.load(std::memory_order_relaxed);
+        }
+
+        return state;
+    }
+
+    // Sets the parked bit and parks until the state changes
+    void Park(std::uint32_t state)
+    {
+        if ((state & ParkedBit) == 0 && !State.compare_exchange_weak(state, state | ParkedBit, std::memory_order_relaxed, std::memory_order_relaxed))
+            return;
+
+        State.wait(state | ParkedBit, std::memory_order_relaxed);
+    }
+
+    // Clears the bits and wakes the parked threads if there are any
+    void ClearAndWake(std::uint32_t bits)
+    {
+        if ((State.fetch_and(~(bits | ParkedBit), std::memory_order_release) & ParkedBit) != 0)
+            State.notify_all();
+    }
+
+    // Tries to get the write lock, and if it is busy, then marks the writer as waiting to stop new readers
+    bool TryWriteLockOrMarkWaiting(std::uint32_t& state)
+    {
+        if (!IsWriterStopped(state))
+            return State.compare_exchange_weak(state, (state | WriterBit) & ~WaitingWriterBit, std::memory_order_acquire, std::memory_order_relaxed);
+
+        if ((state & WaitingWriterBit) == 0)
+            State.compare_exchange_weak(state, state | WaitingWriterBit, std::memory_order_relaxed, std::memory_order_relaxed);
+
+        return false;
+    }
+
+public:
+    /// \brief A method for locking a section of code for reading
+    void ReadLock()
+    {
+        std::uint32_t state = State.load(std::memory_order_relaxed);
+        if (!IsReaderStopped(state) && State.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+            return;
+
+        for (;;)
+        {
+            state = Spin([](std::uint32_t current) { return IsReaderStopped(current); });
+
+            if (!IsReaderStopped(state))
+            {
+                if (State.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                    return;
+            }
+            else
+                Park(state);
+        }
+    }
+
+    /// \brief A method for trying to lock a section of code for reading without waiting
+    /// \return true if locked, false otherwise
+    bool TryReadLock()
+    {
+        std::uint32_t state = State.load(std::memory_order_relaxed);
+        while (!IsReaderStopped(state))
+            if (State.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                return true;
+
+        return false;
+    }
+
+    /// \brief A method for trying to lock a section of code for reading until the time point
+    /// \param [in] timePoint time point to wait until
+    /// \return true if locked, false if the time point is reached
+    template <class Clock, class Duration>
+    bool TryReadLockUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        return WaitUntil(timePoint, [this]() { return TryReadLock(); });
+    }
+
+    /// \brief A method for checking if a writer waits for the code section or is inside it. It costs one load
+    /// \return true if a writer waits, so the readers holding the lock for a long time should let it in, for example with ReadSession
+    bool IsWriterWaiting() const
+    {
+        return (State.load(std::memory_order_relaxed) & (WaitingWriterBit | WriterBit)) != 0;
+    }
+
+    /// \brief A method for unlocking a section of code for reading
+    void ReadUnlock()
+    {
+        std::uint32_t prev = State.fetch_sub(1, std::memory_order_release);
+
+        // Last reader wakes up the parked writer
+        if ((prev & ReaderMask) == 1 && (prev & ParkedBit) != 0)
+            ClearAndWake(0);
+    }
+
+    /// \brief A method for locking a section of code for writing
+    void WriteLock()
+    {
+        std::uint32_t state = 0;
+        if (State.compare_exchange_weak(state, WriterBit, std::memory_order_acquire, std::memory_order_relaxed))
+            return;
+
+        for (;;)
+        {
+            state = State.load(std::memory_order_relaxed);
+            if (TryWriteLockOrMarkWaiting(state))
+                return;
+
+            state = Spin([](std::uint32_t current) { return IsWriterStopped(current); });
+
+            if (!IsWriterStopped(state))
+            {
+                if (TryWriteLockOrMarkWaiting(state))
+                    return;
+            }
+            else
+                Park(state);
+        }
+    }
+
+    /// \brief A method for trying to lock a section of code for writing without waiting
+    /// \return true if locked, false otherwise
+    bool TryWriteLock()
+    {
+        std::uint32_t state = State.load(std::memory_order_relaxed);
+        while (!IsWriterStopped(state))
+            if (State.compare_exchange_weak(state, (state | WriterBit) & ~WaitingWriterBit, std::memory_order_acquire, std::memory_order_relaxed))
+                return true;
+
+        return false;
+    }
+
+    /// \brief A method for trying to lock a section of code for writing until the time point
+    /// \param [in] timePoint time point to wait until
+    /// \return true if locked, false if the time point is reached
+    template <class Clock, class Duration>
+    bool TryWriteLockUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        if (WaitUntil(timePoint, [this]()
+            {
+                std::uint32_t state = State.load(std::memory_order_relaxed);
+                return TryWriteLockOrMarkWaiting(state);
+            }))
+            return true;
+
+        // Let in the readers stopped by this writer. Other waiting writers mark themselves again after the wake up
+        ClearAndWake(WaitingWriterBit);
+        return false;
+    }
+
+    /// \brief A method for unlocking a section of code for writing
+    void WriteUnlock()
+    {
+        ClearAndWake(WriterBit);
+    }
+};
+
+static_assert(sizeof(CompactReadWriteMutex) == 4, "CompactReadWriteMutex must fit in one 32-bit word");
+
+/**
+    \brief Guard for the read lock
+
+    The guard locks the mutex for reading in the constructor and unlocks it in the destructor if it owns the lock.
+    Tags std::defer_lock, std::try_to_lock and std::adopt_lock work as with std::unique_lock.
+    The guard can be moved to another scope and unlocked earlier with Unlock.
+    It has the lock, try_lock and unlock names, so several guards can be locked without deadlock with std::lock.
+    Any lock with lock_shared, try_lock_shared and unlock_shared methods can be used.
+
+    \tparam Mutex lock type
+*/
+template <class Mutex>
+class ReadLock
+{
+private:
+    Mutex* Mtx = nullptr;
+    bool IsOwner = false;
+
+public:
+    /// \brief Constructor of the guard without the mutex
+    ReadLock() {}
+
+    /// \brief Constructor. Locks the mutex for reading
+    /// \param [in] mtx mutex to lock
+    explicit ReadLock(Mutex& mtx) : Mtx(&mtx)
+    {
+        Mtx->lock_shared();
+        IsOwner = true;
+    }
+
+    /// \brief Constructor without locking
+    /// \param [in] mtx mutex to lock later
+    ReadLock(Mutex& mtx, std::defer_lock_t) noexcept : Mtx(&mtx) {}
+
+    /// \brief Constructor with the try to lock. Check the result with OwnsLock
+    /// \param [in] mtx mutex to lock
+    ReadLock(Mutex& mtx, std::try_to_lock_t) : Mtx(&mtx)
+    {
+        IsOwner = Mtx->try_lock_shared();
+    }
+
+    /// \brief Constructor from the mutex already locked for reading by this thread
+    /// \param [in] mtx locked mutex
+    ReadLock(Mutex& mtx, std::adopt_lock_t) noexcept : Mtx(&mtx), IsOwner(true) {}
+
+    ReadLock(const ReadLock&) = delete;
+    ReadLock& operator=(const ReadLock&) = delete;
+
+    /// \brief Move constructor
+    /// \param [in] other other guard. It becomes empty
+    ReadLock(ReadLock&& other) noexcept : Mtx(other.Mtx), IsOwner(other.IsOwner)
+    {
+        other.Mtx = nullptr;
+        other.IsOwner = false;
+    }
+
+    /// \brief Move assignment operator. Unlocks the current mutex if owned
+    /// \param [in] other other guard. It becomes empty
+    ReadLock& operator=(ReadLock&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (IsOwner)
+                Mtx->unlock_shared();
+
+            Mtx = other.Mtx;
+            IsOwner = other.IsOwner;
+            other.Mtx = nullptr;
+            other.IsOwner = false;
+        }
+
+        return *this;
+    }
+
+    /// \brief Method for locking the mutex for reading. The guard must not own the lock
+    void Lock()
+    {
+        Mtx->lock_shared();
+        IsOwner = true;
+    }
+
+    /// \brief Method for trying to lock the mutex for reading. The guard must not own the lock
+    /// \return true if locked, false otherwise
+    bool TryLock()
+    {
+        IsOwner = Mtx->try_lock_shared();
+        return IsOwner;
+    }
+
+    /// \brief Method for the early unlock. The guard must own the lock
+    void Unlock()
+    {
+        Mtx->unlock_shared();
+        IsOwner = false;
+    }
+
+    /// \brief Method for breaking the connection with the mutex without unlocking it
+    /// \return pointer to the mutex
+    Mutex* Release() noexcept
+    {
+        Mutex* mtx = Mtx;
+        Mtx = nullptr;
+        IsOwner = false;
+        return mtx;
+    }
+
+    /// \return true if the guard owns the lock
+    bool OwnsLock() const noexcept { return IsOwner; }
+
+    /// \return true if the guard owns the lock
+    explicit operator bool() const noexcept { return IsOwner; }
+
+    /// \return pointer to the mutex or nullptr
+    Mutex* GetMutex() const noexcept { return Mtx; }
+
+    // Names for std::lock
+    void lock() { Lock(); }
+    bool try_lock() { return TryLock(); }
+    void unlock() { Unlock(); }
+
+    /// \brief Destructor. Unlocks the mutex if owned
+    ~ReadLock()
+    {
+        if (IsOwner)
+            Mtx->unlock_shared();
+    }
+};
+
+/**
+    \brief Guard for the write lock
+
+    The same guard as ReadLock, but for the write lock.
+    Any lock with lock, try_lock and unlock methods can be used.
+
+    \tparam Mutex lock type
+*/
+template <class Mutex>
+class WriteLock
+{
+private:
+    Mutex* Mtx = nullptr;
+    bool IsOwner = false;
+
+public:
+    /// \brief Constructor of the guard without the mutex
+    WriteLock() {}
+
+    /// \brief Constructor. Locks the mutex for writing
+    /// \param [in] mtx mutex to lock
+    explicit WriteLock(Mutex& mtx) : Mtx(&mtx)
+    {
+        Mtx->lock();
+        IsOwner = true;
+    }
+
+    /// \brief Constructor without locking
+    /// \param [in] mtx mutex to lock later
+    WriteLock(Mutex& mtx, std::defer_lock_t) noexcept : Mtx(&mtx) {}
+
+    /// \brief Constructor with the try to lock. Check the result with OwnsLock
+    /// \param [in] mtx mutex to lock
+    WriteLock(Mutex& mtx, std::try_to_lock_t) : Mtx(&mtx)
+    {
+        IsOwner = Mtx->try_lock();
+    }
+
+    /// \brief Constructor from the mutex already locked for writing by this thread
+    /// \param [in] mtx locked mutex
+    WriteLock(Mutex& mtx, std::adopt_lock_t) noexcept : Mtx(&mtx), IsOwner(true) {}
+
+    WriteLock(const WriteLock&) = delete;
+    WriteLock& operator=(const WriteLock&) = delete;
+
+    /// \brief Move constructor
+    /// \param [in] other other guard. It becomes empty
+    WriteLock(WriteLock&& other) noexcept : Mtx(other.Mtx), IsOwner(other.IsOwner)
+    {
+        other.Mtx = nullptr;
+        other.IsOwner = false;
+    }
+
+    /// \brief Move assignment operator. Unlocks the current mutex if owned
+    /// \param [in] other other guard. It becomes empty
+    WriteLock& operator=(WriteLock&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (IsOwner)
+                Mtx->unlock();
+
+            Mtx = other.Mtx;
+            IsOwner = other.IsOwner;
+            other.Mtx = nullptr;
+            other.IsOwner = false;
+        }
+
+        return *this;
+    }
+
+    /// \brief Method for locking the mutex for writing. The guard must not own the lock
+    void Lock()
+    {
+        Mtx->lock();
+        IsOwner = true;
+    }
+
+    /// \brief Method for trying to lock the mutex for writing. The guard must not own the lock
+    /// \return true if locked, false otherwise
+    bool TryLock()
+    {
+        IsOwner = Mtx->try_lock();
+        return IsOwner;
+    }
+
+    /// \brief Method for the early unlock. The guard must own the lock
+    void Unlock()
+    {
+        Mtx->unlock();
+        IsOwner = false;
+    }
+
+    /// \brief Method for breaking the connection with the mutex without unlocking it
+    /// \return pointer to the mutex
+    Mutex* Release() noexcept
+    {
+        Mutex* mtx = Mtx;
+        Mtx = nullptr;
+        IsOwner = false;
+        return mtx;
+    }
+
+    /// \return true if the guard owns the lock
+    bool OwnsLock() const noexcept { return IsOwner; }
+
+    /// \return true if the guard owns the lock
+    explicit operator bool() const noexcept { return IsOwner; }
+
+    /// \return pointer to the mutex or nullptr
+    Mutex* GetMutex() const noexcept { return Mtx; }
+
+    // Names for std::lock
+    void lock() { Lock(); }
+    bool try_lock() { return TryLock(); }
+    void unlock() { Unlock(); }
+
+    /// \brief Destructor. Unlocks the mutex if owned
+    ~WriteLock()
+    {
+        if (IsOwner)
+            Mtx->unlock();
+    }
+};
+
+/**
+    \brief Guard for the read lock of several mutexes at once
+
+    Mutexes are locked with std::lock, so guards taken in different orders by different threads do not deadlock.
+    Read and write locks of different mutexes can be mixed: lock the deferred ReadLock and WriteLock guards with std::lock.
+
+    \tparam Mutexes lock types
+*/
+template <class... Mutexes>
+class ScopedReadLock
+{
+private:
+    std::tuple<ReadLock<Mutexes>...> Guards;
+
+public:
+    /// \brief Constructor. Locks all mutexes for reading
+    /// \param [in] mtxs mutexes to lock. Must be different
+    explicit ScopedReadLock(Mutexes&... mtxs) : Guards(ReadLock<Mutexes>(mtxs, std::defer_lock)...)
+    {
+        if constexpr (sizeof...(Mutexes) == 1)
+            std::get<0>(Guards).Lock();
+        else if constexpr (sizeof...(Mutexes) > 1)
+            std::apply([](ReadLock<Mutexes>&... guards) { std::lock(guards...); }, Guards);
+    }
+
+    ScopedReadLock(const ScopedReadLock&) = delete;
+    ScopedReadLock& operator=(const ScopedReadLock&) = delete;
+};
+
+/**
+    \brief Guard for the write lock of several mutexes at once
+
+    The same guard as ScopedReadLock, but for the write lock.
+
+    \tparam Mutexes lock types
+*/
+template <class... Mutexes>
+class ScopedWriteLock
+{
+private:
+    std::tuple<WriteLock<Mutexes>...> Guards;
+
+public:
+    /// \brief Constructor. Locks all mutexes for writing
+    /// \param [in] mtxs mutexes to lock. Must be different
+    explicit ScopedWriteLock(Mutexes&... mtxs) : Guards(WriteLock<Mutexes>(mtxs, std::defer_lock)...)
+    {
+        if constexpr (sizeof...(Mutexes) == 1)
+            std::get<0>(Guards).Lock();
+        else if constexpr (sizeof...(Mutexes) > 1)
+            std::apply([](WriteLock<Mutexes>&... guards) { std::lock(guards...); }, Guards);
+    }
+
+    ScopedWriteLock(const ScopedWriteLock&) = delete;
+    ScopedWriteLock& operator=(const ScopedWriteLock&) = delete;
+};
+
+/**
+    \brief An object protected by the read write lock
+
+    Instead of locking the mutex by hand around each access to the object, the access is given to the callback under the lock.
+    Read gives const T& to the callback under the read lock, so readers work in parallel, and Write gives T& under the write lock.
+    The lock is released when the callback returns or throws. The reference must not be saved outside of the callback.
+    Any lock with lock, unlock, lock_shared and unlock_shared methods can be used, for example ThreadCrossWalk.
+
+    \tparam T object type
+    \tparam Lock lock type
+*/
+template <class T, class Lock = ReadWriteMutex<>>
+class SharedGuarded
+{
+private:
+    T Value;
+
+    // Lock is changed by the const Read
+    mutable Lock Mtx;
+
+public:
+    /// \brief Constructor
+    /// \param [in] args arguments for the object constructor
+    template <class... Args>
+    explicit SharedGuarded(Args&&... args) : Value(std::forward<Args>(args)...) {}
+
+    SharedGuarded(const SharedGuarded&) = delete;
+    SharedGuarded& operator=(const SharedGuarded&) = delete;
+
+    /// \brief Method for reading the object
+    /// \param [in] function function that gets const T&
+    /// \return result of the function
+    template <class Function>
+    decltype(auto) Read(Function function) const
+    {
+        std::shared_lock<Lock> lk(Mtx);
+        return function(static_cast<const T&>(Value));
+    }
+
+    /// \brief Method for changing the object
+    /// \param [in] function function that gets T&
+    /// \return result of the function
+    template <class Function>
+    decltype(auto) Write(Function function)
+    {
+        std::unique_lock<Lock> lk(Mtx);
+        return function(Value);
+    }
+
+    /// \brief Method for getting the lock, for example to get the statistics
+    /// \return lock of the object
+    Lock& GetLock() const
+    {
+        return Mtx;
+    }
+};
@@ -0,0 +1,348 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+
+#include "ReadWriteMutex.h"
+
+/**
+    \brief A secure mutex class
+
+    This class provides shared access to the mutex.
+    To explain this class, consider an example. There are 2 objects of classes A and B. 
+    An object of class B stores a pointer to an object of class A. The thread safety of class A is provided using std::mutex. 
+    To access object A from B, a mutex is used inside A. When object A is deleted, the pointer to it inside B ceases to be valid.
+    This class solves this problem. 
+    Objects of this class are divided into 2 types: parent and non-parent. The parent is created in the main object, A if we talk about the example above, 
+    and not the parent is not created in the main ones, i.e. B from the example above.
+    Memory is allocated only in parent, as one control block with the mutex, the counter and the validity flag.
+    Each copy of the object increases the counter by 1, each destruction of the object decreases the counter by 1.
+    Memory is freed when the counter becomes 0. Copying, destruction and GetIsValid do not lock the mutex,
+    only the destruction of the parent takes it to wait for the threads working inside Lock and Unlock.
+    MutexValidator uses std::recursive_mutex, other mutex types with lock, try_lock and unlock methods can be set with the template parameter.
+
+    \tparam Mutex mutex type
+*/
+template <class Mutex>
+class BasicMutexValidator
+{
+private:
+
+    // Data shared by the parent and all copies
+    struct ControlBlock
+    {
+        // Mutex for thread-safety
+        Mutex Mtx;
+
+        // Counter to store ref amount
+        std::atomic<std::size_t> Counter{1};
+
+        // Variable to store info about main object validity
+        std::atomic<bool> IsValid{true};
+    };
+
+    ControlBlock* Block = nullptr;
+
+    // Standard mutexes are checked by the validator if LOCK_ORDER_CHECKING is defined. Lock classes of this repo check themselves
+    static constexpr bool IsCheckedMutex = std::is_same<Mutex, std::mutex>::value || std::is_same<Mutex, std::timed_mutex>::value ||
+        std::is_same<Mutex, std::recursive_mutex>::value || std::is_same<Mutex, std::recursive_timed_mutex>::value;
+    static constexpr bool IsRecursiveMutex = std::is_same<Mutex, std::recursive_mutex>::value || std::is_same<Mutex, std::recursive_timed_mutex>::value;
+
+    // Bool variable to mark original object
+    bool IsOriginal;
+
+    // Decreases the counter and frees the control block if it was the last ref. Does nothing for the moved from object
+    void Release()
+    {
+        if (Block != nullptr && Block->Counter.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            if constexpr (IsCheckedMutex)
+                LockOrderChecker::OnDestroy(&Block->Mtx);
+            delete Block;
+        }
+    }
+
+public:
+
+    /// \brief Default constructor
+    BasicMutexValidator()
+    {
+        Block = new ControlBlock;
+        IsOriginal = true;
+    }
+
+    /// \brief Copy constructor
+    /// \param [in] other other MutexValidator object
+    BasicMutexValidator(const BasicMutexValidator& other)
+    {
+        Block = other.Block;
+        Block->Counter.fetch_add(1, std::memory_order_relaxed);
+        IsOriginal = false;
+    }
+
+    /// \brief Move constructor
+    /// \param [in] other other MutexValidator object. It becomes empty and only can be destroyed or assigned
+    BasicMutexValidator(BasicMutexValidator&& other) noexcept
+    {
+        Block = other.Block;
+        IsOriginal = other.IsOriginal;
+
+        other.Block = nullptr;
+        other.IsOriginal = false;
+    }
+
+    /// \brief Assignment operator
+    /// \param [in] other other MutexValidator object
+    BasicMutexValidator& operator=(const BasicMutexValidator& other)
+    {
+        // Check if it is not same object
+        if (this != &other)
+        {
+            // Take the new block before releasing the old one, since they can be the same
+            other.Block->Counter.fetch_add(1, std::memory_order_relaxed);
+            Release();
+
+            Block = other.Block;
+            IsOriginal = false;
+        }
+
+        return *this;
+    }
+
+    /// \brief Move assignment operator
+    /// \param [in] other other MutexValidator object. It becomes empty and only can be destroyed or assigned
+    BasicMutexValidator& operator=(BasicMutexValidator&& other) noexcept
+    {
+        // Check if it is not same object
+        if (this != &other)
+        {
+            Release();
+
+            Block = other.Block;
+            IsOriginal = other.IsOriginal;
+
+            other.Block = nullptr;
+            other.IsOriginal = false;
+        }
+
+        return *this;
+    }
+
+    /// \brief Method for checking main object validity
+    /// \warning Main object can be destroyed right after this call, so it must be used inside Lock and Unlock to work with the main object
+    /// \return main object validity. False for the moved from object
+    bool GetIsValid()
+    {
+        return Block != nullptr && Block->IsValid.load(std::memory_order_acquire);
+    }
+
+    /// \brief Lock code section to thread-safety
+    void Lock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        if constexpr (IsCheckedMutex)
+            LockOrderChecker::OnAcquire(&Block->Mtx, true, IsRecursiveMutex, LOCK_ORDER_SITE);
+        Block->Mtx.lock();
+    }
+
+    /// \brief Try to lock code section to thread-safety
+    /// \return true if locked, false otherwise
+    bool TryLock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        if (!Block->Mtx.try_lock())
+            return false;
+
+        if constexpr (IsCheckedMutex)
+            LockOrderChecker::OnTryAcquire(&Block->Mtx, true, LOCK_ORDER_SITE);
+        return true;
+    }
+
+    /// \brief Unlock code section to thread-safety
+    void Unlock(LOCK_ORDER_SITE_PARAMETER)
+    {
+        if constexpr (IsCheckedMutex)
+            LockOrderChecker::OnRelease(&Block->Mtx, true, LOCK_ORDER_SITE);
+        Block->Mtx.unlock();
+    }
+
+    /// \brief Method for getting the shared mutex, for example to lock it for reading
+    /// \warning Must not be called on the moved from object
+    /// \return shared mutex
+    Mutex& GetMutex()
+    {
+        return Block->Mtx;
+    }
+
+    /// \brief Default destructor
+    ~BasicMutexValidator()
+    {
+        // Parent waits for the threads that work with the main object
+        if (IsOriginal)
+        {
+            Block->Mtx.lock();
+            Block->IsValid.store(false, std::memory_order_release);
+            Block->Mtx.unlock();
+        }
+
+        Release();
+    }
+};
+
+/// \brief MutexValidator with std::recursive_mutex
+using MutexValidator = BasicMutexValidator<std::recursive_mutex>;
+
+/**
+    \brief A weak reference to the object that locks and validates in one step
+
+    The parent ValidatedRef is created inside the object with the pointer to it, and copies are given to other objects.
+    Copies get access to the object with TryReadAccess and TryWriteAccess. They return the guard that keeps the object
+    locked, or the empty guard if the parent is already destroyed. Object is protected by ReadWriteMutex,
+    so readers of the same object work in parallel. The parent destructor waits for all guards to be destroyed.
+    The parent should be the last member of the object, so it is destroyed before the other members.
+
+    \warning The thread that destroys the parent must not hold a guard of it, since ReadWriteMutex is not recursive
+
+    \tparam T object type
+*/
+template <class T>
+class ValidatedRef
+{
+private:
+    BasicMutexValidator<ReadWriteMutex<>> Validator;
+
+    // Pointer to the object
+    T* Object = nullptr;
+
+public:
+    /// \brief Guard for the read access to the object. Empty guard means that the object is destroyed
+    class ReadAccess
+    {
+    private:
+        ReadWriteMutex<>* Rwmx = nullptr;
+        const T* Object = nullptr;
+
+    public:
+        /// \brief Constructor of the empty guard
+        ReadAccess() {}
+
+        /// \brief Constructor of the guard from the locked for reading mutex
+        /// \param [in] rwmx mutex locked for reading
+        /// \param [in] object pointer to the object
+        ReadAccess(ReadWriteMutex<>& rwmx, const T* object) : Rwmx(&rwmx), Object(object) {}
+
+        ReadAccess(const ReadAccess&) = delete;
+        ReadAccess& operator=(const ReadAccess&) = delete;
+
+        /// \brief Move constructor
+        /// \param [in] other other guard. It becomes empty
+        ReadAccess(ReadAccess&& other) noexcept : Rwmx(other.Rwmx), Object(other.Object)
+        {
+            other.Rwmx = nullptr;
+            other.Object = nullptr;
+        }
+
+        /// \return true if the guard is not empty
+        explicit operator bool() const { return Object != nullptr; }
+
+        /// \warning Must not be called on the empty guard
+        const T* operator->() const { return Object; }
+
+        /// \warning Must not be called on the empty guard
+        const T& operator*() const { return *Object; }
+
+        /// \brief Destructor. Unlocks the object
+        ~ReadAccess()
+        {
+            if (Rwmx != nullptr)
+                Rwmx->ReadUnlock();
+        }
+    };
+
+    /// \brief Guard for the write access to the object. Empty guard means that the object is destroyed
+    class WriteAccess
+    {
+    private:
+        ReadWriteMutex<>* Rwmx = nullptr;
+        T* Object = nullptr;
+
+    public:
+        /// \brief Constructor of the empty guard
+        WriteAccess() {}
+
+        /// \brief Constructor of the guard from the locked for writing mutex
+        /// \param [in] rwmx mutex locked for writing
+        /// \param [in] object pointer to the object
+        WriteAccess(ReadWriteMutex<>& rwmx, T* object) : Rwmx(&rwmx), Object(object) {}
+
+        WriteAccess(const WriteAccess&) = delete;
+        WriteAccess& operator=(const WriteAccess&) = delete;
+
+        /// \brief Move constructor
+        /// \param [in] other other guard. It becomes empty
+        WriteAccess(WriteAccess&& other) noexcept : Rwmx(other.Rwmx), Object(other.Object)
+        {
+            other.Rwmx = nullptr;
+            other.Object = nullptr;
+        }
+
+        /// \return true if the guard is not empty
+        explicit operator bool() const { return Object != nullptr; }
+
+        /// \warning Must not be called on the empty guard
+        T* operator->() const { return Object; }
+
+        /// \warning Must not be called on the empty guard
+        T& operator*() const { return *Object; }
+
+        /// \brief Destructor. Unlocks the object
+        ~WriteAccess()
+        {
+            if (Rwmx != nullptr)
+                Rwmx->WriteUnlock();
+        }
+    };
+
+    /// \brief Constructor of the parent
+    /// \param [in] object pointer to the object that creates the parent
+    explicit ValidatedRef(T* object) : Object(object) {}
+
+    /// \brief Method for getting the read access to the object
+    /// \return guard with the object locked for reading, or the empty guard if the object is destroyed
+    ReadAccess TryReadAccess()
+    {
+        if (!Validator.GetIsValid())
+            return ReadAccess();
+
+        ReadWriteMutex<>& rwmx = Validator.GetMutex();
+        rwmx.ReadLock();
+
+        // Parent could be destroyed while waiting for the lock
+        if (!Validator.GetIsValid())
+        {
+            rwmx.ReadUnlock();
+            return ReadAccess();
+        }
+
+        return ReadAccess(rwmx, Object);
+    }
+
+    /// \brief Method for getting the write access to the object
+    /// \return guard with the object locked for writing, or the empty guard if the object is destroyed
+    WriteAccess TryWriteAccess()
+    {
+        if (!Validator.GetIsValid())
+            return WriteAccess();
+
+        ReadWriteMutex<>& rwmx = Validator.GetMutex();
+        rwmx.WriteLock();
+
+        // Parent could be destroyed while waiting for the lock
+        if (!Validator.GetIsValid())
+        {
+            rwmx.WriteUnlock();
+            return WriteAccess();
+        }
+
+        return WriteAccess(rwmx, Object);
+    }
+};
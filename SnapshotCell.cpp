@@ -0,0 +1,45 @@
+#include <thread>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "SnapshotCell.h"
+
+SnapshotCell<std::map<std::string, int>> Config(std::map<std::string, int>{ { "first", 0 }, { "second", 0 } });
+
+void Reader()
+{
+    for (int i = 0; i < 100000; ++i)
+    {
+        SnapshotCell<std::map<std::string, int>>::Snapshot config = Config.Load();
+
+        if (config->at("first") != config->at("second"))
+            std::cout << "Error! First: " << config->at("first") << " Second: " << config->at("second") << std::endl;
+    }
+}
+
+void Writer()
+{
+    // Readers see either the old or the new version, but never the half changed one
+    for (int i = 0; i < 1000; ++i)
+        Config.Update([](std::map<std::string, int>& config)
+            {
+                ++config["first"];
+                ++config["second"];
+            });
+}
+
+int main()
+{
+    std::thread th1(Reader);
+    std::thread th2(Reader);
+    std::thread th3(Writer);
+    std::thread th4(Writer);
+
+    th1.join();
+    th2.join();
+    th3.join();
+    th4.join();
+
+    std::cout << "First: " << Config.Load()->at("first") << std::endl;
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+#include "ReadWriteMutex.h"
+
+/**
+    \brief A cell with immutable snapshots of the object for read-mostly data
+
+    Readers take the current version of the object with Load and keep it alive with the returned snapshot without any lock.
+    Writers are serialized by the write lock of ReadWriteMutex, copy the current version, change the copy and publish it atomically.
+    Old versions are destroyed by the last snapshot that holds them, so writers never wait for readers and readers never wait for writers.
+
+    Versions are counted with the split reference count. The cell word holds the pointer to the current version in the lower 48 bits
+    and the external count in the upper 16 bits, so Load is one atomic increment of the word.
+    Snapshot destruction gives the reference back to the word while the version is still current, or to the internal count of the version after it was replaced.
+    When the version is replaced, the writer moves the external count to the internal one, and the version is destroyed when the internal count becomes zero.
+    So there must be less than 65536 snapshots of one version at the same moment, and the pointers must fit in 48 bits.
+    Both limits are checked with assert in the debug builds.
+
+    \warning All snapshots must be destroyed before the cell
+
+    \tparam T object type
+*/
+template <class T>
+class SnapshotCell
+{
+private:
+    static_assert(sizeof(void*) == 8, "SnapshotCell: the pointer and the counter are packed into 64 bits");
+
+    static constexpr std::uint64_t PointerMask = (std::uint64_t(1) << 48) - 1;
+    static constexpr std::uint64_t ExternalOne = std::uint64_t(1) << 48;
+
+    // Version of the object with the internal count
+    struct Version
+    {
+        const T Value;
+
+        // Moved external count minus the references released after the replacement
+        std::atomic<std::int64_t> InternalCount{0};
+
+        template <class... Args>
+        explicit Version(Args&&... args) : Value(std::forward<Args>(args)...) {}
+    };
+
+    // Pointer to the current version and the external count
+    std::atomic<std::uint64_t> Word;
+
+    // Lock to serialize writers
+    ReadWriteMutex<> WriterMtx;
+
+    static Version* GetVersion(std::uint64_t word)
+    {
+        return reinterpret_cast<Version*>(static_cast<std::uintptr_t>(word & PointerMask));
+    }
+
+    static std::uint64_t MakeWord(Version* version)
+    {
+        std::uint64_t word = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(version));
+
+        // Upper bits are taken by the external count
+        assert((word & ~PointerMask) == 0 && "SnapshotCell: the pointer does not fit in 48 bits");
+        return word;
+    }
+
+    // Gives back one reference of the version taken by Load
+    void Release(Version* version)
+    {
+        // Version can not be destroyed while this reference is alive, so the same pointer means the same version
+        std::uint64_t word = Word.load(std::memory_order_relaxed);
+        while (GetVersion(word) == version)
+            if (Word.compare_exchange_weak(word, word - ExternalOne, std::memory_order_release, std::memory_order_relaxed))
+                return;
+
+        // Version was replaced and its external count was moved to the internal one
+        if (version->InternalCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete version;
+    }
+
+    // Replaces the current version and moves the external count of the old one. Called only by the thread owning WriterMtx
+    void Replace(Version* version)
+    {
+        std::uint64_t oldWord = Word.exchange(MakeWord(version), std::memory_order_acq_rel);
+        Version* oldVersion = GetVersion(oldWord);
+
+        std::int64_t external = static_cast<std::int64_t>(oldWord >> 48);
+        if (oldVersion->InternalCount.fetch_add(external, std::memory_order_acq_rel) + external == 0)
+            delete oldVersion;
+    }
+
+public:
+    /// \brief Snapshot of one version. The version stays alive and unchanged until the snapshot is destroyed
+    class Snapshot
+    {
+    private:
+        friend class SnapshotCell;
+
+        SnapshotCell* Cell = nullptr;
+        Version* Ver = nullptr;
+
+        Snapshot(SnapshotCell* cell, Version* version) : Cell(cell), Ver(version) {}
+
+    public:
+        /// \brief Constructor of the empty snapshot
+        Snapshot() {}
+
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        /// \brief Move constructor
+        /// \param [in] other other snapshot. It becomes empty
+        Snapshot(Snapshot&& other) noexcept : Cell(other.Cell), Ver(other.Ver)
+        {
+            other.Cell = nullptr;
+            other.Ver = nullptr;
+        }
+
+        /// \brief Move assignment operator
+        /// \param [in] other other snapshot. It becomes empty
+        Snapshot& operator=(Snapshot&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (Ver != nullptr)
+                    Cell->Release(Ver);
+
+                Cell = other.Cell;
+                Ver = other.Ver;
+                other.Cell = nullptr;
+                other.Ver = nullptr;
+            }
+
+            return *this;
+        }
+
+        /// \return true if the snapshot is not empty
+        explicit operator bool() const { return Ver != nullptr; }
+
+        /// \warning Must not be called on the empty snapshot
+        const T* operator->() const { return &Ver->Value; }
+
+        /// \warning Must not be called on the empty snapshot
+        const T& operator*() const { return Ver->Value; }
+
+        /// \brief Destructor. Releases the version
+        ~Snapshot()
+        {
+            if (Ver != nullptr)
+                Cell->Release(Ver);
+        }
+    };
+
+    /// \brief Constructor
+    /// \param [in] args arguments for the constructor of the first version
+    template <class... Args>
+    explicit SnapshotCell(Args&&... args)
+    {
+        Word.store(MakeWord(new Version(std::forward<Args>(args)...)));
+    }
+
+    SnapshotCell(const SnapshotCell&) = delete;
+    SnapshotCell& operator=(const SnapshotCell&) = delete;
+
+    /// \brief Method for getting the current version. It never waits
+    /// \return snapshot of the current version
+    Snapshot Load()
+    {
+        std::uint64_t word = Word.fetch_add(ExternalOne, std::memory_order_acquire);
+
+        // 65536th snapshot of one version would wrap the external count to zero, so the version would be destroyed while in use
+        assert((word >> 48) != 0xFFFF && "SnapshotCell: too many snapshots of one version");
+        return Snapshot(this, GetVersion(word));
+    }
+
+    /// \brief Method for publishing the new version. Snapshots of the old version stay valid
+    /// \param [in] value new version of the object
+    void Store(T value)
+    {
+        Version* version = new Version(std::move(value));
+
+        std::unique_lock<ReadWriteMutex<>> lk(WriterMtx);
+        Replace(version);
+    }
+
+    /**
+        \brief Changes the copy of the current version and publishes it
+
+        Writers are serialized with each other, so changes are not lost, but readers are not stopped.
+
+        \param [in] change function that gets T& of the copy and changes it
+    */
+    template <class Function>
+    void Update(Function change)
+    {
+        std::unique_lock<ReadWriteMutex<>> lk(WriterMtx);
+
+        // Only the writer replaces the version, so the current one can be read without the reference
+        T value(GetVersion(Word.load(std::memory_order_acquire))->Value);
+        change(value);
+        Replace(new Version(std::move(value)));
+    }
+
+    /// \brief Destructor. Destroys the current version
+    ~SnapshotCell()
+    {
+        delete GetVersion(Word.load());
+    }
+};